@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include "include/chip8.h"
+#include "include/audio.h"
+#include "include/ring.h"
+
+#define MAX_PERIOD      1024
+
+struct Audio {
+    Ring edges;
+    SDL_AudioDeviceID device;
+
+    // emulator side, the last edge that went into the ring
+    AudioEdge pushed;
+
+    // callback side, nothing else touches these once the device runs
+    int rate;
+    int16_t wave[MAX_PERIOD];
+    int period;
+    int phase;
+    bool on;
+    bool has_pattern;
+    uint8_t pattern[AUDIO_PATTERN_BITS / 8];
+    uint32_t step;
+    uint32_t pattern_phase;     // 16.16 fixed point bit position in the pattern
+    uint64_t position;          // in samples of emulated time, lagging by the latency
+    AudioEdge next;
+    uint64_t next_at;
+    bool has_next;
+};
+
+// Edges are stamped in the timers' FRAME_RATE frames, this is the sample a
+// frame's edge plays at.
+static uint64_t edge_sample(const Audio* audio, uint64_t frame) {
+    return (frame + AUDIO_LATENCY_FRAMES) * audio->rate / FRAME_RATE;
+}
+
+// Pop the next edge and put the playback clock back on the emulated one
+// when the edge is way off it: late by more than the latency means the
+// emulator stalled (rewind, a dragged window), early by a lot means it ran
+// ahead (dropped frames, turbo).
+static void fetch_edge(Audio* audio) {
+    if (ring_pop(&audio->edges, &audio->next, 1) == 0) {
+        audio->has_next = false;
+        return;
+    }
+    audio->has_next = true;
+    audio->next_at = edge_sample(audio, audio->next.frame);
+
+    uint64_t latency = edge_sample(audio, 0);
+    if (audio->next_at + latency < audio->position || audio->next_at > audio->position + 4 * latency) {
+        audio->position = audio->next_at;
+    }
+}
+
+static void audio_callback(void* userdata, Uint8* stream, int len) {
+
+    Audio* audio = userdata;
+    int16_t* out = (int16_t*)stream;
+    int samples = len / (int)sizeof(int16_t);
+
+    for (int i = 0; i < samples; i++) {
+        if (!audio->has_next) {
+            fetch_edge(audio);
+        }
+        while (audio->has_next && audio->next_at <= audio->position) {
+            audio->on = audio->next.on;
+            audio->has_pattern = audio->next.has_pattern;
+            memcpy(audio->pattern, audio->next.pattern, sizeof(audio->pattern));
+            audio->step = audio->next.step;
+            fetch_edge(audio);
+        }
+
+        if (audio->on && audio->has_pattern) {
+            uint32_t bit = audio->pattern_phase >> 16;
+            out[i] = (audio->pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? AUDIO_VOLUME : -AUDIO_VOLUME;
+            audio->pattern_phase = (audio->pattern_phase + audio->step) & ((AUDIO_PATTERN_BITS << 16) - 1);
+        } else if (audio->on) {
+            out[i] = audio->wave[audio->phase];
+            audio->phase = audio->phase + 1 == audio->period ? 0 : audio->phase + 1;
+        } else {
+            out[i] = 0;
+            audio->phase = 0;
+            audio->pattern_phase = 0;
+        }
+        audio->position++;
+    }
+
+}
+
+Audio* audio_open(void) {
+
+    Audio* audio = calloc(1, sizeof(Audio));
+    if (audio == NULL) {
+        return NULL;
+    }
+    if (!ring_init(&audio->edges, AUDIO_RING_EDGES, sizeof(AudioEdge))) {
+        free(audio);
+        return NULL;
+    }
+
+    SDL_AudioSpec want = {0};
+    SDL_AudioSpec have;
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = AUDIO_BUFFER_SAMPLES;
+    want.callback = audio_callback;
+    want.userdata = audio;
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0
+        || (audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0)) == 0) {
+        error("[FAILED] Could not open audio, running silent: %s\n", SDL_GetError());
+        ring_free(&audio->edges);
+        free(audio);
+        return NULL;
+    }
+
+    // one period of the tone, high for the first half and low for the second
+    audio->rate = have.freq;
+    audio->period = audio->rate / AUDIO_TONE_HZ;
+    if (audio->period > MAX_PERIOD) {
+        audio->period = MAX_PERIOD;
+    } else if (audio->period < 2) {
+        audio->period = 2;
+    }
+    for (int i = 0; i < audio->period; i++) {
+        audio->wave[i] = i < audio->period / 2 ? AUDIO_VOLUME : -AUDIO_VOLUME;
+    }
+
+    SDL_PauseAudioDevice(audio->device, 0);
+    printf("[OK] Audio initialized at %dHz\n", audio->rate);
+    return audio;
+
+}
+
+void audio_close(Audio* audio) {
+    if (audio == NULL) {
+        return;
+    }
+    SDL_CloseAudioDevice(audio->device);
+    ring_free(&audio->edges);
+    free(audio);
+}
+
+void audio_frame(Audio* audio, uint64_t frame, bool on, const uint8_t* pattern, uint8_t pitch) {
+    if (audio == NULL) {
+        return;
+    }
+
+    AudioEdge edge = {.frame = frame, .on = on, .has_pattern = pattern != NULL};
+    if (pattern) {
+        memcpy(edge.pattern, pattern, sizeof(edge.pattern));
+        double hz = AUDIO_PATTERN_HZ * SDL_pow(2.0, (pitch - 64) / 48.0);
+        edge.step = (uint32_t)(hz / audio->rate * 65536.0);
+    }
+
+    AudioEdge* last = &audio->pushed;
+    if (edge.on == last->on && edge.has_pattern == last->has_pattern && edge.step == last->step
+        && memcmp(edge.pattern, last->pattern, sizeof(edge.pattern)) == 0) {
+        return;
+    }
+    if (ring_push(&audio->edges, &edge)) {
+        *last = edge;
+    }
+}
@@ -0,0 +1,477 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/decode.h"
+#include "include/ops.h"
+#include "include/batch.h"
+
+// Lockstep batch engine, see include/batch.h.
+//
+// The lane loops run over all BATCH_LANES lanes whether they take part in
+// the step or not: a lane outside the mask works out the new value like the
+// others and then keeps its old one. With no branches in them the loops
+// vectorize (SSE2 or NEON out of the box, AVX2 when the compiler flags allow
+// it), which costs less than picking the lanes out one by one.
+
+// 0xFFFF for a lane in the mask, 0 for one sitting the step out
+static inline uint16_t wide(uint8_t mask) {
+    return (uint16_t)(int16_t)(int8_t)mask;
+}
+
+static inline uint8_t pick(uint8_t mask, uint8_t on, uint8_t off) {
+    return (on & mask) | (off & ~mask);
+}
+
+static inline uint16_t lane_opcode(const Chip8* c8, uint16_t pc) {
+    return c8->memory[pc & c8->memory_mask] << 8 | c8->memory[(pc + 1) & c8->memory_mask];
+}
+
+// Lane l's registers from its machine.
+static void load_lane(Batch* batch, int l) {
+    const Chip8* c8 = batch->lane[l];
+    for (int x = 0; x < 16; x++) {
+        batch->V[x][l] = c8->V[x];
+    }
+    batch->I[l] = c8->I;
+    batch->PC[l] = c8->PC;
+    batch->delay_timer[l] = c8->delay_timer;
+    batch->sound_timer[l] = c8->sound_timer;
+}
+
+// And back into the machine.
+static void store_lane(Batch* batch, int l) {
+    Chip8* c8 = batch->lane[l];
+    for (int x = 0; x < 16; x++) {
+        c8->V[x] = batch->V[x][l];
+    }
+    c8->I = batch->I[l];
+    c8->PC = batch->PC[l];
+    c8->delay_timer = batch->delay_timer[l];
+    c8->sound_timer = batch->sound_timer[l];
+}
+
+// Run the next instruction of one lane on its own machine, the way
+// run_instructions() would: a draw under the display wait ends the lane's
+// frame, an idle loop skips the rest of it.
+static void step_lane(Batch* batch, int l) {
+
+    Chip8* c8 = batch->lane[l];
+    store_lane(batch, l);
+    c8->idle = IDLE_NONE;
+    bool stop = emulate_cycle(c8);
+    batch->left[l]--;
+    batch->ran[l]++;
+    if (stop) {
+        if (c8->idle != IDLE_NONE) {
+            skip_idle_run(c8, batch->left[l]);
+            batch->ran[l] += batch->left[l];
+            batch->idle |= 1u << l;
+        }
+        batch->left[l] = 0;
+    }
+    batch->written |= c8->dirty_pages;
+    c8->dirty_pages = 0;
+    load_lane(batch, l);
+
+}
+
+// Run one instruction on every lane at the lowest PC a lane with
+// instructions left is at. The lowest PC first gives lanes that split up at
+// a branch the best chance of meeting again. Returns false once no lane has
+// anything left to run.
+static bool batch_step(Batch* batch) {
+
+    // lanes with nothing left count as 0xFFFF, the mask below leaves them
+    // out even when a lane with instructions left really is at 0xFFFF
+    uint16_t lowest = 0xFFFF;
+    uint8_t any = 0;
+    for (int l = 0; l < BATCH_LANES; l++) {
+        uint16_t pc = batch->PC[l] | (uint16_t)-(batch->left[l] == 0);
+        lowest = pc < lowest ? pc : lowest;
+        any |= batch->left[l];
+    }
+    if (!any) {
+        return false;
+    }
+
+    uint8_t mask[BATCH_LANES];
+    for (int l = 0; l < BATCH_LANES; l++) {
+        mask[l] = -(uint8_t)((batch->left[l] != 0) & (batch->PC[l] == lowest));
+    }
+
+    // Lanes that started with the same memory still hold the same opcode
+    // here unless one of them wrote to its pages, only then compare them
+    // with the first lane there.
+    const Chip8* c8 = batch->lane[0];
+    uint16_t pc = lowest & c8->memory_mask;
+    uint64_t pages = 1ull << DIRTY_PAGE(pc) | 1ull << DIRTY_PAGE((pc + 1) & c8->memory_mask);
+    uint16_t op = lane_opcode(c8, pc);
+    if (!batch->shared_code || (batch->written & pages)) {
+        int first = 0;
+        while (!mask[first]) {
+            first++;
+        }
+        op = lane_opcode(batch->lane[first], pc);
+        for (int l = first + 1; l < BATCH_LANES; l++) {
+            if (mask[l] && lane_opcode(batch->lane[l], pc) != op) {
+                mask[l] = 0;
+            }
+        }
+    }
+
+    uint8_t x = (op >> 8) & 0xF;
+    uint8_t y = (op >> 4) & 0xF;
+    uint8_t n = op & 0xF;
+    uint8_t nn = op & 0xFF;
+    uint16_t nnn = op & 0xFFF;
+    Chip8Quirks quirks = c8->quirks;
+
+    // XO-CHIP skips step over F000 NNNN as a whole, so how far they go
+    // depends on memory, those run lane by lane
+    bool plain_skips = c8->variant != VARIANT_XOCHIP;
+
+    uint8_t* vx = batch->V[x];
+    uint8_t* vy = batch->V[y];
+    uint8_t* vf = batch->V[0xF];
+
+    // a draw under the display wait ends the frame for every lane it ran on
+    bool ends_frame = false;
+
+    switch (decode_handler(op, c8->variant)) {
+        case OP_1NNN:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] = (nnn & wide(mask[l])) | (batch->PC[l] & ~wide(mask[l]));
+            }
+            break;
+        case OP_BNNN: {
+            const uint8_t* offset = batch->V[QUIRK_JUMP_VX(quirks) ? x : 0];
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint16_t target = offset[l] + nnn;
+                batch->PC[l] = (target & wide(mask[l])) | (batch->PC[l] & ~wide(mask[l]));
+            }
+            break;
+        }
+        case OP_3XNN:
+            if (!plain_skips) goto lane_by_lane;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] += (vx[l] == nn ? 4 : 2) & wide(mask[l]);
+            }
+            break;
+        case OP_4XNN:
+            if (!plain_skips) goto lane_by_lane;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] += (vx[l] != nn ? 4 : 2) & wide(mask[l]);
+            }
+            break;
+        case OP_5XY0:
+            if (!plain_skips) goto lane_by_lane;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] += (vx[l] == vy[l] ? 4 : 2) & wide(mask[l]);
+            }
+            break;
+        case OP_9XY0:
+            if (!plain_skips) goto lane_by_lane;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] += (n == 0 && vx[l] != vy[l] ? 4 : 2) & wide(mask[l]);
+            }
+            break;
+        case OP_EX9E:
+            if (!plain_skips) goto lane_by_lane;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] += ((batch->keys[l] >> (vx[l] & 0xF)) & 1 ? 4 : 2) & wide(mask[l]);
+            }
+            break;
+        case OP_EXA1:
+            if (!plain_skips) goto lane_by_lane;
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->PC[l] += ((batch->keys[l] >> (vx[l] & 0xF)) & 1 ? 2 : 4) & wide(mask[l]);
+            }
+            break;
+        case OP_6XNN:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                vx[l] = pick(mask[l], nn, vx[l]);
+            }
+            goto next;
+        case OP_7XNN:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                vx[l] += nn & mask[l];
+            }
+            goto next;
+        case OP_8XY0:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                vx[l] = pick(mask[l], vy[l], vx[l]);
+            }
+            goto next;
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint8_t value = n == 1 ? vx[l] | vy[l] : n == 2 ? vx[l] & vy[l] : vx[l] ^ vy[l];
+                vx[l] = pick(mask[l], value, vx[l]);
+            }
+            if (QUIRK_VF_RESET(quirks)) {
+                for (int l = 0; l < BATCH_LANES; l++) {
+                    vf[l] &= ~mask[l];
+                }
+            }
+            goto next;
+        case OP_8XY4:
+            // the flag goes in last so it wins when X is F, same as op_8xy4()
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint16_t sum = vx[l] + vy[l];
+                uint8_t carry = sum > 255;
+                vx[l] = pick(mask[l], sum & 0xFF, vx[l]);
+                vf[l] = pick(mask[l], carry, vf[l]);
+            }
+            goto next;
+        case OP_8XY5:
+        case OP_8XY7:
+            // VF first and VX only when it isn't VF, same as op_8xy5()
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint8_t from = n == 5 ? vx[l] : vy[l];
+                uint8_t take = n == 5 ? vy[l] : vx[l];
+                uint8_t diff = from - take;
+                vf[l] = pick(mask[l], from >= take, vf[l]);
+                if (x != 0xF) {
+                    vx[l] = pick(mask[l], diff, vx[l]);
+                }
+            }
+            goto next;
+        case OP_8XY6:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint8_t value = QUIRK_SHIFT_VX(quirks) ? vx[l] : vy[l];
+                vx[l] = pick(mask[l], value >> 1, vx[l]);
+                vf[l] = pick(mask[l], value & 1, vf[l]);
+            }
+            goto next;
+        case OP_8XYE:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint8_t value = QUIRK_SHIFT_VX(quirks) ? vx[l] : vy[l];
+                vx[l] = pick(mask[l], value << 1, vx[l]);
+                vf[l] = pick(mask[l], value >> 7, vf[l]);
+            }
+            goto next;
+        case OP_ANNN:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->I[l] = (nnn & wide(mask[l])) | (batch->I[l] & ~wide(mask[l]));
+            }
+            goto next;
+        case OP_FX1E:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->I[l] += vx[l] & wide(mask[l]);
+            }
+            goto next;
+        case OP_FX29:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                uint16_t digit = (vx[l] & 0xF) * 5;
+                batch->I[l] = (digit & wide(mask[l])) | (batch->I[l] & ~wide(mask[l]));
+            }
+            goto next;
+        case OP_FX15:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->delay_timer[l] = pick(mask[l], vx[l], batch->delay_timer[l]);
+            }
+            goto next;
+        case OP_FX18:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                batch->sound_timer[l] = pick(mask[l], vx[l], batch->sound_timer[l]);
+            }
+            goto next;
+
+        // These go through ops.h on each lane's machine, which still has its
+        // memory, stack and display, handing over only the registers the
+        // instruction reads and taking back the ones it writes. PC stays
+        // here, the machine's goes stale until store_lane().
+        case OP_2NNN:
+        case OP_00EE:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                if (mask[l]) {
+                    Chip8* machine = batch->lane[l];
+                    machine->PC = batch->PC[l];
+                    if (op == 0x00EE) {
+                        op_00ee(machine);
+                    } else {
+                        op_2nnn(machine, nnn);
+                    }
+                    batch->PC[l] = machine->PC;
+                }
+            }
+            break;
+        case OP_CXNN:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                if (mask[l]) {
+                    op_cxnn(batch->lane[l], x, nn);
+                    vx[l] = batch->lane[l]->V[x];
+                }
+            }
+            goto next;
+        case OP_DXYN:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                if (mask[l]) {
+                    Chip8* machine = batch->lane[l];
+                    machine->V[x] = vx[l];
+                    machine->V[y] = vy[l];
+                    machine->I = batch->I[l];
+                    op_dxyn(machine, x, y, n, quirks);
+                    vf[l] = machine->V[0xF];
+                }
+            }
+            ends_frame = QUIRK_DISPLAY_WAIT(quirks);
+            goto next;
+        case OP_FX33:
+        case OP_FX55:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                if (mask[l]) {
+                    Chip8* machine = batch->lane[l];
+                    for (int i = 0; i <= x; i++) {
+                        machine->V[i] = batch->V[i][l];
+                    }
+                    machine->I = batch->I[l];
+                    if (nn == 0x33) {
+                        op_fx33(machine, x);
+                    } else {
+                        op_fx55(machine, x, quirks);
+                    }
+                    batch->I[l] = machine->I;
+                    batch->written |= machine->dirty_pages;
+                    machine->dirty_pages = 0;
+                }
+            }
+            goto next;
+        case OP_FX65:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                if (mask[l]) {
+                    Chip8* machine = batch->lane[l];
+                    machine->I = batch->I[l];
+                    op_fx65(machine, x, quirks);
+                    for (int i = 0; i <= x; i++) {
+                        batch->V[i][l] = machine->V[i];
+                    }
+                    batch->I[l] = machine->I;
+                }
+            }
+            goto next;
+
+        default:
+        lane_by_lane:
+            for (int l = 0; l < BATCH_LANES; l++) {
+                if (mask[l]) {
+                    step_lane(batch, l);
+                }
+            }
+            return true;
+    }
+    goto done;
+
+next:
+    for (int l = 0; l < BATCH_LANES; l++) {
+        batch->PC[l] += 2 & wide(mask[l]);
+    }
+
+done:
+    for (int l = 0; l < BATCH_LANES; l++) {
+        batch->left[l] -= mask[l] & 1;
+        batch->ran[l] += mask[l] & 1;
+    }
+    if (ends_frame) {
+        for (int l = 0; l < BATCH_LANES; l++) {
+            batch->left[l] &= ~mask[l];
+        }
+    }
+    return true;
+
+}
+
+// Run every lane the way run_headless() runs a machine, until it hits the
+// instruction or frame limit, and leave what each ran in batch->instructions
+// and batch->frames. The frames are in lockstep, every lane that still has
+// one to go runs it before any lane starts its next. The registers stay here
+// from start to finish, a lane only goes back to its machine for the frames
+// it ends idle, where end_headless_frame() may skip the ones after.
+void batch_run(Batch* batch, uint64_t max_instructions, uint64_t max_frames) {
+
+    if (batch->lanes <= 0) {
+        return;
+    }
+
+    const Chip8* first = batch->lane[0];
+    batch->shared_code = true;
+    batch->written = 0;
+    batch->idle = 0;
+    for (int l = 0; l < BATCH_LANES; l++) {
+        batch->instructions[l] = 0;
+        batch->frames[l] = 0;
+        batch->keys[l] = 0;
+        if (l >= batch->lanes) {
+            continue;
+        }
+
+        Chip8* c8 = batch->lane[l];
+        c8->dirty_pages = 0;
+        if (memcmp(c8->memory, first->memory, (size_t)first->memory_mask + 1) != 0) {
+            batch->shared_code = false;
+        }
+        load_lane(batch, l);
+        for (int key = 0; key < 16; key++) {
+            batch->keys[l] |= (c8->keypad[key] ? 1u : 0u) << key;
+        }
+    }
+
+    uint8_t running[BATCH_LANES];
+    for (;;) {
+        uint8_t any = 0;
+        for (int l = 0; l < BATCH_LANES; l++) {
+            uint64_t remaining = max_instructions - batch->instructions[l];
+            running[l] = l < batch->lanes && batch->instructions[l] < max_instructions
+                         && batch->frames[l] < max_frames;
+            batch->left[l] = running[l] ? (remaining < HEADLESS_INSTRUCTIONS ? remaining : HEADLESS_INSTRUCTIONS) : 0;
+            batch->ran[l] = 0;
+            any |= running[l];
+        }
+        if (!any) {
+            break;
+        }
+
+        while (batch_step(batch)) {
+        }
+
+        // the end of the frame, tick_timers() for every lane still running
+        for (int l = 0; l < BATCH_LANES; l++) {
+            uint8_t on = -running[l];
+            batch->delay_timer[l] -= (batch->delay_timer[l] > 0) & on;
+            batch->sound_timer[l] -= (batch->sound_timer[l] > 0) & on;
+            batch->instructions[l] += batch->ran[l];
+            batch->frames[l] += running[l];
+        }
+
+        // lanes that ended the frame idle get their timers back untouched
+        // and let end_headless_frame() skip whatever comes after
+        for (uint32_t idle = batch->idle; idle; idle &= idle - 1) {
+            int l = 0;
+            while (!(idle & (1u << l))) {
+                l++;
+            }
+            Chip8* c8 = batch->lane[l];
+            batch->delay_timer[l] = c8->delay_timer;
+            batch->sound_timer[l] = c8->sound_timer;
+            store_lane(batch, l);
+            batch->frames[l]--;
+            uint64_t ended = end_headless_frame(c8, max_instructions - batch->instructions[l],
+                                                max_frames - batch->frames[l]);
+            batch->instructions[l] += (ended - 1) * HEADLESS_INSTRUCTIONS;
+            batch->frames[l] += ended;
+            c8->idle = IDLE_NONE;
+            load_lane(batch, l);
+        }
+        batch->idle = 0;
+    }
+
+    for (int l = 0; l < batch->lanes; l++) {
+        store_lane(batch, l);
+        batch->lane[l]->draw_flag = 0;
+    }
+
+}
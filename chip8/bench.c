@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "include/chip8.h"
+
+// chip8_bench: runs a fixed set of workloads headless on every core and
+// prints one JSON document, so runs can be diffed and tracked over time.
+//
+// The built-in workloads are small generated roms (a compute loop, a sprite
+// scene, BCD/FX55/FX65 memory traffic) plus one unrolled loop per opcode
+// class for the ns per instruction table. Any rom files given on the command
+// line (the Timendus test suite, games...) are benchmarked as well.
+
+#define BENCH_INSTRUCTIONS  20000000ull
+#define BENCH_REPEATS       3
+
+// copies of the instruction in each opcode class loop, the jump back is
+// one instruction in UNROLL + 1 so it barely shows
+#define UNROLL  64
+
+typedef struct Workload {
+    const char* name;
+    uint8_t rom[0x400];
+    size_t size;
+} Workload;
+
+static void emit(Workload* w, uint16_t op) {
+    w->rom[w->size++] = op >> 8;
+    w->rom[w->size++] = op & 0xFF;
+}
+
+static void emit_all(Workload* w, const uint16_t* ops, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        emit(w, ops[i]);
+    }
+}
+
+// V0 counts, V1/V2 mix it up, loops forever
+static const uint16_t compute_rom[] = {
+    0x6000, 0x6101, 0x6200,
+    0x7001, 0x8014, 0x8125, 0x8216, 0x820E, 0x8103,
+    0x3000, 0x1206, 0x7201, 0x4210, 0x1206, 0x6200, 0x1206,
+};
+
+// font digits drawn all over the screen, cleared every pass
+static const uint16_t sprites_rom[] = {
+    0x00E0, 0x6000, 0x6100, 0x6200,
+    0xF229, 0xD015, 0x7008, 0x7201, 0x6F0F, 0x82F2, 0x3040, 0x1208,
+    0x6000, 0x7106, 0x311E, 0x1208, 0x6100, 0x00E0, 0x1208,
+};
+
+// BCD of a counter, read back and stored again
+static const uint16_t memory_rom[] = {
+    0xA300, 0x6000,
+    0xF033, 0xF265, 0xF255, 0x7001, 0xA300, 0x30FF, 0x1204, 0x1200,
+};
+
+typedef struct OpClass {
+    const char* name;
+    uint16_t setup;     // runs once before the loop, 0 for none
+    uint16_t body[2];   // unrolled, body[1] is 0 for one instruction bodies
+} OpClass;
+
+static const OpClass op_classes[] = {
+    {"00E0", 0, {0x00E0, 0}},
+    {"3XNN", 0, {0x3001, 0}},           // V0 is 0, never skips
+    {"6XNN", 0, {0x6012, 0}},
+    {"7XNN", 0, {0x7001, 0}},
+    {"8XY4", 0, {0x8014, 0}},
+    {"8XY6", 0, {0x8016, 0}},
+    {"ANNN", 0, {0xAE00, 0}},
+    {"CXNN", 0, {0xC0FF, 0}},
+    {"DXYN", 0, {0xD015, 0}},
+    {"EX9E", 0, {0xE09E, 0}},           // no keys down, never skips
+    {"FX1E", 0, {0xF01E, 0}},
+    {"FX33", 0xAE00, {0xF033, 0}},
+    {"ANNN+FX55", 0, {0xAE00, 0xFF55}}, // FX55/FX65 move I, ANNN puts it back
+    {"ANNN+FX65", 0, {0xAE00, 0xFF65}},
+};
+
+#define OP_CLASS_COUNT (sizeof(op_classes) / sizeof(op_classes[0]))
+
+static void build_op_class(Workload* w, const OpClass* op) {
+    w->name = op->name;
+    w->size = 0;
+    if (op->setup) {
+        emit(w, op->setup);
+    }
+    uint16_t loop = 0x200 + w->size;
+    for (int i = 0; i < UNROLL; i++) {
+        emit(w, op->body[0]);
+        if (op->body[1]) {
+            emit(w, op->body[1]);
+        }
+    }
+    emit(w, 0x1000 | loop);
+}
+
+typedef struct Measurement {
+    uint64_t instructions;
+    uint64_t frames;
+    double seconds;
+} Measurement;
+
+// Best of BENCH_REPEATS runs from reset, rom is either a file or in memory.
+static bool measure(Chip8* c8, Chip8Core core, const Workload* w, char* path,
+                    uint64_t instructions, int repeats, Measurement* best) {
+
+    if (!select_core(c8, core)) {
+        return false;
+    }
+
+    best->seconds = -1;
+    for (int r = 0; r < repeats; r++) {
+        init_cpu(c8);
+        if (path) {
+            if (load_rom(c8, path)) {
+                return false;
+            }
+        } else {
+            load_rom_data(c8, w->rom, w->size);
+        }
+
+        struct timespec start;
+        Measurement m;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        m.instructions = run_headless(c8, instructions, UINT64_MAX, &m.frames);
+        m.seconds = seconds_since(&start);
+
+        if (best->seconds < 0 || m.seconds < best->seconds) {
+            *best = m;
+        }
+    }
+
+    return true;
+
+}
+
+static void print_measurement(const char* workload, Chip8Core core, const Measurement* m, bool last) {
+    double seconds = m->seconds > 0 ? m->seconds : 1e-9;
+    printf("    {\"workload\": \"%s\", \"core\": \"%s\", \"instructions\": %llu, \"frames\": %llu, "
+           "\"seconds\": %.6f, \"mips\": %.2f, \"fps\": %.0f}%s\n",
+           workload, core_name(core), (unsigned long long)m->instructions,
+           (unsigned long long)m->frames, m->seconds, m->instructions / seconds / 1e6,
+           m->frames / seconds, last ? "" : ",");
+}
+
+static void usage(void) {
+    error("Usage: chip8_bench [-n instructions] [-r repeats] [-c core] [rom.ch8 ...]\n"
+          "  -n instructions  instructions per workload run (default 20000000)\n"
+          "  -r repeats       runs per workload, the fastest one is reported (default 3)\n"
+          "  -c core          only benchmark this core (default: all of them)\n");
+}
+
+int main(int argc, char** argv) {
+
+    uint64_t instructions = BENCH_INSTRUCTIONS;
+    int repeats = BENCH_REPEATS;
+    Chip8Core cores[] = {CORE_SWITCH, CORE_PREDECODED, CORE_BLOCK};
+    int core_count = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:c:")) != -1) {
+        switch (opt) {
+            case 'n':
+                instructions = strtoull(optarg, NULL, 10);
+                break;
+            case 'r':
+                repeats = atoi(optarg) > 0 ? atoi(optarg) : 1;
+                break;
+            case 'c':
+                if (!parse_core(optarg, &cores[0])) {
+                    error("[FAILED] unknown core %s\n", optarg);
+                    return 1;
+                }
+                core_count = 1;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    Workload workloads[3] = {{.name = "compute"}, {.name = "sprites"}, {.name = "memory"}};
+    emit_all(&workloads[0], compute_rom, sizeof(compute_rom) / sizeof(compute_rom[0]));
+    emit_all(&workloads[1], sprites_rom, sizeof(sprites_rom) / sizeof(sprites_rom[0]));
+    emit_all(&workloads[2], memory_rom, sizeof(memory_rom) / sizeof(memory_rom[0]));
+
+    static Chip8 c8;
+    c8.seed = 1;
+    Measurement m;
+    bool ok = true;
+
+    printf("{\n  \"instructions_per_run\": %llu,\n  \"repeats\": %d,\n  \"results\": [\n",
+           (unsigned long long)instructions, repeats);
+
+    int rom_count = argc - optind;
+    for (int c = 0; c < core_count; c++) {
+        for (int i = 0; i < 3; i++) {
+            ok &= measure(&c8, cores[c], &workloads[i], NULL, instructions, repeats, &m);
+            print_measurement(workloads[i].name, cores[c], &m, rom_count == 0 && i == 2 && c == core_count - 1);
+        }
+        for (int i = 0; i < rom_count; i++) {
+            char* path = argv[optind + i];
+            if (!measure(&c8, cores[c], NULL, path, instructions, repeats, &m)) {
+                error("[FAILED] Could not load rom %s\n", path);
+                memset(&m, 0, sizeof(m));
+                ok = false;
+            }
+            print_measurement(path, cores[c], &m, i == rom_count - 1 && c == core_count - 1);
+        }
+    }
+
+    printf("  ],\n  \"ns_per_instruction\": {\n");
+    for (int c = 0; c < core_count; c++) {
+        printf("    \"%s\": {", core_name(cores[c]));
+        for (size_t i = 0; i < OP_CLASS_COUNT; i++) {
+            Workload w;
+            build_op_class(&w, &op_classes[i]);
+            ok &= measure(&c8, cores[c], &w, NULL, instructions / 4, repeats, &m);
+            double ns = m.instructions ? m.seconds * 1e9 / m.instructions : 0;
+            printf("%s\"%s\": %.2f", i ? ", " : "", w.name, ns);
+        }
+        printf("}%s\n", c == core_count - 1 ? "" : ",");
+    }
+
+    release_cores(&c8);
+
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("  },\n  \"peak_rss_kb\": %ld\n}\n", ru.ru_maxrss);
+
+    return ok ? 0 : 1;
+
+}
@@ -0,0 +1,318 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/capture.h"
+
+// frames the writer takes out of the ring at a time
+#define CAPTURE_BATCH       16
+
+// the GIF's colours, the window's palette
+static const uint8_t capture_palette[4][3] = {
+    {0x00, 0x00, 0x00},
+    {0xFF, 0xFF, 0xFF},
+    {0xFF, 0x55, 0x00},
+    {0x55, 0xAA, 0xFF},
+};
+
+// 4 colours, so 2 bit codes to start from: clear is 4, end of image 5
+#define LZW_MIN_CODE_SIZE   2
+#define LZW_CLEAR           (1 << LZW_MIN_CODE_SIZE)
+#define LZW_END             (LZW_CLEAR + 1)
+#define LZW_MAX_CODES       4096
+
+// GIF's LZW, the dictionary a table of children per code and colour, and the
+// codes packed LSB first into sub-blocks of up to 255 bytes.
+typedef struct Lzw {
+    FILE* file;
+    uint16_t children[LZW_MAX_CODES][4];
+    int next_code;
+    int code_size;
+    uint32_t bits;
+    int bit_count;
+    uint8_t block[255];
+    int block_size;
+} Lzw;
+
+static void lzw_byte(Lzw* lzw, uint8_t byte) {
+    lzw->block[lzw->block_size++] = byte;
+    if (lzw->block_size == 255) {
+        fputc(255, lzw->file);
+        fwrite(lzw->block, 1, 255, lzw->file);
+        lzw->block_size = 0;
+    }
+}
+
+static void lzw_code(Lzw* lzw, int code) {
+    lzw->bits |= (uint32_t)code << lzw->bit_count;
+    lzw->bit_count += lzw->code_size;
+    while (lzw->bit_count >= 8) {
+        lzw_byte(lzw, lzw->bits & 0xFF);
+        lzw->bits >>= 8;
+        lzw->bit_count -= 8;
+    }
+}
+
+static void lzw_reset(Lzw* lzw) {
+    memset(lzw->children, 0, sizeof(lzw->children));
+    lzw->next_code = LZW_END + 1;
+    lzw->code_size = LZW_MIN_CODE_SIZE + 1;
+}
+
+// One image's pixels, colours 0-3, as the image data block.
+static void lzw_encode(Lzw* lzw, const uint8_t* pixels, size_t count) {
+
+    fputc(LZW_MIN_CODE_SIZE, lzw->file);
+    lzw->bits = 0;
+    lzw->bit_count = 0;
+    lzw->block_size = 0;
+    lzw_reset(lzw);
+    lzw_code(lzw, LZW_CLEAR);
+
+    int code = pixels[0];
+    for (size_t i = 1; i < count; i++) {
+        uint8_t pixel = pixels[i];
+        uint16_t child = lzw->children[code][pixel];
+        if (child) {
+            code = child;
+            continue;
+        }
+        lzw_code(lzw, code);
+        if (lzw->next_code < LZW_MAX_CODES) {
+            if (lzw->next_code == (1 << lzw->code_size)) {
+                lzw->code_size++;
+            }
+            lzw->children[code][pixel] = (uint16_t)lzw->next_code++;
+        } else {
+            lzw_code(lzw, LZW_CLEAR);
+            lzw_reset(lzw);
+        }
+        code = pixel;
+    }
+    lzw_code(lzw, code);
+    lzw_code(lzw, LZW_END);
+
+    if (lzw->bit_count) {
+        lzw_byte(lzw, lzw->bits & 0xFF);
+    }
+    if (lzw->block_size) {
+        fputc(lzw->block_size, lzw->file);
+        fwrite(lzw->block, 1, lzw->block_size, lzw->file);
+    }
+    fputc(0, lzw->file);
+
+}
+
+static void put_u16(FILE* file, uint16_t value) {
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+// Header, the palette as the global colour table and the loop forever
+// extension.
+static void write_gif_header(Capture* capture) {
+    FILE* file = capture->file;
+    fwrite("GIF89a", 1, 6, file);
+    put_u16(file, (uint16_t)capture->width);
+    put_u16(file, (uint16_t)capture->height);
+    fputc(0x80 | 0x01, file);       // global colour table of 2^(1+1) colours
+    fputc(0, file);
+    fputc(0, file);
+    fwrite(capture_palette, 1, sizeof(capture_palette), file);
+    fwrite("\x21\xFF\x0B" "NETSCAPE2.0" "\x03\x01\x00\x00\x00", 1, 19, file);
+}
+
+// Frame n's time in the GIF's hundredths of a second, rounded.
+static uint64_t frame_centiseconds(uint64_t frame) {
+    return (frame * 100 + FRAME_RATE / 2) / FRAME_RATE;
+}
+
+// The writer's side: what the canvas shows and the frame waiting for its
+// delay, which only the next frame tells.
+typedef struct CaptureWriter {
+    Lzw lzw;
+    uint8_t* pixels;
+    CaptureFrame shown;
+    CaptureFrame pending;
+    bool has_shown;
+    bool has_pending;
+} CaptureWriter;
+
+// Write the pending frame over the rows that changed since the shown one,
+// for `until` - its frame long.
+static void write_pending(Capture* capture, CaptureWriter* writer, uint64_t until) {
+
+    const CaptureFrame* frame = &writer->pending;
+    const CaptureFrame* shown = &writer->shown;
+    int rows = frame->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    int pixel = capture->width / (frame->hires ? HIRES_WIDTH : SCREEN_WIDTH);
+
+    int first = 0;
+    int last = rows - 1;
+    if (writer->has_shown && shown->hires == frame->hires) {
+        while (first < rows && !memcmp(frame->display[0][first], shown->display[0][first], sizeof(frame->display[0][first]))
+                            && !memcmp(frame->display[1][first], shown->display[1][first], sizeof(frame->display[1][first]))) {
+            first++;
+        }
+        while (last > first && !memcmp(frame->display[0][last], shown->display[0][last], sizeof(frame->display[0][last]))
+                            && !memcmp(frame->display[1][last], shown->display[1][last], sizeof(frame->display[1][last]))) {
+            last--;
+        }
+        if (first == rows) {
+            // a repeat of what's shown, only its time counts
+            first = 0;
+            last = 0;
+        }
+    }
+
+    int top = first * pixel;
+    int height = (last - first + 1) * pixel;
+    uint8_t* out = writer->pixels;
+    for (int y = first; y <= last; y++) {
+        uint8_t* row = out;
+        for (int x = 0; x < capture->width; x++) {
+            *out++ = (uint8_t)display_color(&frame->display[0][0][0], x / pixel, y);
+        }
+        for (int copy = 1; copy < pixel; copy++) {
+            memcpy(out, row, capture->width);
+            out += capture->width;
+        }
+    }
+
+    // GIF delays top out at 65535, a frame held longer gets repeated
+    uint64_t start = frame_centiseconds(frame->frame);
+    uint64_t end = frame_centiseconds(until);
+    do {
+        uint64_t delay = end - start > UINT16_MAX ? UINT16_MAX : end - start;
+        FILE* file = capture->file;
+        fwrite("\x21\xF9\x04", 1, 3, file);
+        fputc(1 << 2, file);            // disposal: leave the frame in place
+        put_u16(file, (uint16_t)delay);
+        fputc(0, file);
+        fputc(0, file);
+
+        fputc(0x2C, file);
+        put_u16(file, 0);
+        put_u16(file, (uint16_t)top);
+        put_u16(file, (uint16_t)capture->width);
+        put_u16(file, (uint16_t)height);
+        fputc(0, file);
+        lzw_encode(&writer->lzw, writer->pixels, (size_t)capture->width * height);
+        start += delay;
+    } while (start < end);
+
+    writer->shown = writer->pending;
+    writer->has_shown = true;
+
+}
+
+static void free_writer(Capture* capture) {
+    if (capture->state) {
+        free(capture->state->pixels);
+        free(capture->state);
+        capture->state = NULL;
+    }
+}
+
+static void write_frames(void* user, const void* batch, size_t count) {
+    Capture* capture = user;
+    CaptureWriter* writer = capture->state;
+    const CaptureFrame* frames = batch;
+
+    for (size_t i = 0; i < count; i++) {
+        if (writer->has_pending) {
+            write_pending(capture, writer, frames[i].frame);
+        }
+        writer->pending = frames[i];
+        writer->has_pending = true;
+    }
+}
+
+// Start capturing c8's display to a GIF at path, scale screen pixels per
+// high resolution pixel. c8's variant decides the canvas, so set it first.
+// NULL when the file can't be opened or memory runs out.
+Capture* capture_open(const char* path, const Chip8* c8, int scale) {
+
+    Capture* capture = calloc(1, sizeof(Capture));
+    if (capture == NULL) {
+        return NULL;
+    }
+
+    capture->file = fopen(path, "wb");
+    if (capture->file == NULL) {
+        free(capture);
+        return NULL;
+    }
+
+    bool big = c8->variant != VARIANT_CHIP8;
+    capture->scale = scale;
+    capture->width = (big ? HIRES_WIDTH : SCREEN_WIDTH) * scale;
+    capture->height = (big ? HIRES_HEIGHT : SCREEN_HEIGHT) * scale;
+
+    CaptureWriter* writer = calloc(1, sizeof(CaptureWriter));
+    capture->state = writer;
+    if (writer) {
+        writer->pixels = malloc((size_t)capture->width * capture->height);
+        writer->lzw.file = capture->file;
+    }
+    write_gif_header(capture);
+    if (writer == NULL || writer->pixels == NULL
+            || !ring_writer_start(&capture->writer, CAPTURE_RING_FRAMES, sizeof(CaptureFrame), CAPTURE_BATCH,
+                                  5000000, write_frames, capture)) {
+        free_writer(capture);
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+
+    return capture;
+
+}
+
+// The frame c8 just finished, called from tick_timers(). A repeat of the
+// last frame costs a compare, a new one a copy into the ring.
+void capture_frame(Capture* capture, const Chip8* c8) {
+
+    uint64_t frame = capture->frame++;
+    if (capture->has_last && capture->last.hires == c8->hires
+            && !memcmp(capture->last.display, c8->display, sizeof(c8->display))) {
+        return;
+    }
+    capture->last.frame = frame;
+    memcpy(capture->last.display, c8->display, sizeof(c8->display));
+    capture->last.hires = c8->hires;
+    capture->has_last = true;
+
+    // never drops a frame, only waits when the encoder is a whole ring behind
+    ring_push_wait(&capture->writer.ring, &capture->last);
+
+}
+
+// Write out the frames still queued and finish the file. Returns false if
+// any of it couldn't be written.
+bool capture_close(Capture* capture) {
+
+    if (capture == NULL) {
+        return true;
+    }
+
+    ring_writer_stop(&capture->writer);
+
+    // the last frame is held until the end, only now is its delay known
+    CaptureWriter* writer = capture->state;
+    if (writer->has_pending) {
+        uint64_t end = capture->frame > writer->pending.frame ? capture->frame : writer->pending.frame + 1;
+        write_pending(capture, writer, end);
+    }
+    fputc(0x3B, capture->file);
+
+    free_writer(capture);
+    bool ok = !ferror(capture->file);
+    ok = fclose(capture->file) == 0 && ok;
+    free(capture);
+    return ok;
+
+}
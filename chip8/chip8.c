@@ -0,0 +1,642 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+
+#include "include/chip8.h"
+#include "include/trace.h"
+#include "include/profile.h"
+#include "include/ops.h"
+#include "include/block.h"
+#include "include/debug.h"
+#include "include/capture.h"
+
+// Font:
+uint8_t fontset[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0,  // 0
+    0x20, 0x60, 0x20, 0x20, 0x70,  // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0,  // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0,  // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10,  // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0,  // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0,  // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40,  // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0,  // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0,  // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90,  // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0,  // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0,  // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0,  // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0,  // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80   // F
+};
+
+// SUPER-CHIP's big font for FX30, 8x10, loaded at BIG_FONT_ADDR. SUPER-CHIP
+// itself only had the digits, A-F are XO-CHIP's.
+uint8_t big_fontset[160] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C,  // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C,  // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF,  // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C,  // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06,  // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C,  // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C,  // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60,  // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C,  // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C,  // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,  // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,  // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,  // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,  // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0   // F
+};
+
+//////////////////////////////////
+// CHIP-8 Functionality:        //
+//////////////////////////////////
+
+// A machine reset and ready for a rom, on its own heap allocation. Returns
+// NULL if the machine or its core's tables can't be allocated.
+Chip8* chip8_create(Chip8Core core, uint64_t seed) {
+
+    Chip8* c8 = calloc(1, sizeof(Chip8));
+    if (c8 == NULL) {
+        return NULL;
+    }
+    if (!select_core(c8, core)) {
+        release_cores(c8);
+        free(c8);
+        return NULL;
+    }
+    c8->seed = seed;
+    init_cpu(c8);
+    return c8;
+
+}
+
+void chip8_destroy(Chip8* c8) {
+    if (c8 == NULL) {
+        return;
+    }
+    release_cores(c8);
+    free(c8->big_memory);
+    free(c8);
+}
+
+// Make sure c8 has the memory a variant needs, allocating XO-CHIP's 64KB (and
+// a pre-decoded table to cover it) the first time. A machine keeps them once
+// it has them, they go with the machine. False when they can't be allocated.
+bool size_memory(Chip8* c8, Chip8Variant variant) {
+    if (variant != VARIANT_XOCHIP) {
+        return true;
+    }
+    if (c8->big_memory == NULL) {
+        c8->big_memory = calloc(1, MEMORY_SIZE);
+        if (c8->big_memory == NULL) {
+            return false;
+        }
+    }
+    // the pre-decoded table grows with it, whatever it held gets reset anyway
+    if (c8->decoded && c8->decoded_size < MEMORY_SIZE) {
+        DecodedOp* decoded = calloc(MEMORY_SIZE, sizeof(DecodedOp));
+        if (decoded == NULL) {
+            return false;
+        }
+        free(c8->decoded);
+        c8->decoded = decoded;
+        c8->decoded_size = MEMORY_SIZE;
+    }
+    return true;
+}
+
+// Switch the machine to another variant, which resets it (memory size, font
+// and display all depend on it). Load the rom after this. False (and the
+// machine left as it was) when there's no memory for XO-CHIP's 64KB.
+bool chip8_set_variant(Chip8* c8, Chip8Variant variant) {
+    if (!size_memory(c8, variant)) {
+        return false;
+    }
+    c8->variant = variant;
+    c8->quirks = variant_quirks(variant);
+    init_cpu(c8);
+    return true;
+}
+
+// Run the machine under another quirk profile from its next instruction on,
+// nothing is reset and nothing any core cached depends on it.
+void chip8_set_quirks(Chip8* c8, Chip8Quirks quirks) {
+    c8->quirks = quirks;
+}
+
+// Make dst an exact copy of src, random generator, variant and profile
+// included, in two flat copies: the memory src's variant addresses (4KB for
+// CHIP-8) and everything from the registers down to the host's fields. dst
+// keeps its own core and attachments, anything they cached is thrown away.
+// False (and dst left as it was) only when dst has no XO-CHIP memory yet and
+// it can't be allocated.
+bool chip8_copy(Chip8* dst, const Chip8* src) {
+
+    if (!size_memory(dst, src->variant)) {
+        return false;
+    }
+    dst->memory = src->variant == VARIANT_XOCHIP ? dst->big_memory : dst->base_memory;
+    memcpy(dst->memory, src->memory, (size_t)src->memory_mask + 1);
+    memcpy(&dst->V, &src->V, offsetof(Chip8, core) - offsetof(Chip8, V));
+    dst->variant = src->variant;
+    dst->quirks = src->quirks;
+    dst->seed = src->seed;
+    if (dst->decoded || dst->blocks) {
+        mem_written(dst, 0, dst->memory_mask + 1);
+    }
+    return true;
+
+}
+
+// Set the whole keypad from a mask, bit n is key n.
+void chip8_set_keys(Chip8* c8, uint16_t keys) {
+    for (int key = 0; key < 16; key++) {
+        c8->keypad[key] = (keys >> key) & 1;
+    }
+}
+
+// The packed display, DISPLAY_PLANES planes of HIRES_HEIGHT rows of
+// ROW_WORDS words, see display_pixel(). Only the top-left 64x32 of it is
+// used while c8->hires is off.
+const uint64_t* chip8_framebuffer(const Chip8* c8) {
+    return &c8->display[0][0][0];
+}
+
+// FNV-1a of the display, what fleet runs and the conformance suite compare.
+// A plain CHIP-8 machine only hashes its 64x32 words, the same bytes the
+// display was before the bigger variants came along, so hashes from older
+// runs still compare.
+uint32_t chip8_display_hash(const Chip8* c8) {
+    uint32_t hash = 2166136261u;
+    if (c8->variant == VARIANT_CHIP8) {
+        for (int row = 0; row < SCREEN_HEIGHT; row++) {
+            const uint8_t* bytes = (const uint8_t*)&c8->display[0][row][0];
+            for (size_t i = 0; i < sizeof(uint64_t); i++) {
+                hash = (hash ^ bytes[i]) * 16777619u;
+            }
+        }
+        return hash;
+    }
+    const uint8_t* bytes = (const uint8_t*)c8->display;
+    for (size_t i = 0; i < sizeof(c8->display); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void init_cpu(Chip8* c8) {
+
+    // Start every machine from a known state, instances get reused between
+    // runs. The host's attachments (core, trace...) survive the reset but
+    // anything cached from the old memory contents can't.
+    memset(c8, 0, offsetof(Chip8, core));
+    if (c8->variant == VARIANT_XOCHIP && c8->big_memory) {
+        c8->memory = c8->big_memory;
+        c8->memory_mask = MEMORY_SIZE - 1;
+        memset(c8->memory, 0, MEMORY_SIZE);
+    } else {
+        c8->memory = c8->base_memory;
+        c8->memory_mask = CHIP8_MEMORY - 1;
+    }
+    if (c8->decoded) {
+        memset(c8->decoded, 0, (c8->memory_mask + 1) * sizeof(DecodedOp));
+    }
+    if (c8->blocks) {
+        block_cache_flush(c8->blocks, c8->memory_mask + 1);
+    }
+    c8->dirty_pages = 0;
+    c8->PC = 0x200;
+    c8->key_pressed = 255;
+    c8->planes = 1;
+    c8->pitch = 64;
+    c8->dirty_rows = ~0ull;
+
+    // Seed CXNN's generator, from the host's seed so resets are repeatable.
+    seed_random(c8, c8->seed);
+
+    // load the fontset into memory
+    memcpy(c8->memory, fontset, sizeof(fontset));
+    if (c8->variant != VARIANT_CHIP8) {
+        memcpy(c8->memory + BIG_FONT_ADDR, big_fontset, sizeof(big_fontset));
+    }
+
+}
+
+// Copy a rom that's already in memory to 0x200, returns -1 if it doesn't fit.
+int load_rom_data(Chip8* c8, const uint8_t* data, size_t size) {
+
+    if (size > (size_t)c8->memory_mask + 1 - 0x200) {
+        return -1;
+    }
+    memcpy(c8->memory + 0x200, data, size);
+    mem_written(c8, 0x200, size);
+    return 0;
+
+}
+
+int load_rom(Chip8* c8, char* filename) {
+
+    FILE* fp = fopen(filename, "rb");
+
+    if (fp == NULL) return errno;
+
+    struct stat file_stat;
+    stat(filename, &file_stat);
+    size_t file_size = file_stat.st_size;
+
+    size_t bytes_read = fread(c8->memory + 0x200, 1, (size_t)c8->memory_mask + 1 - 0x200, fp);
+
+    fclose(fp);
+
+    mem_written(c8, 0x200, bytes_read);
+
+    if (bytes_read != file_size) {
+        // ensure that the entire rom is loaded in, if not early return to error out
+        return -1;
+    }
+
+    return 0;
+
+}
+
+// The fetch, decode and execute cycle lives in core_switch.c, instantiated once
+// per quirk profile like the other cores.
+
+// Switch a machine to another core, allocating whatever the core needs.
+// Returns false (and leaves the machine as it was) if that fails.
+bool select_core(Chip8* c8, Chip8Core core) {
+
+    if (core == CORE_PREDECODED && c8->decoded == NULL) {
+        // zeroed entries are OP_UNDECODED, they get filled in as they run,
+        // and size_memory() grows the table if the machine becomes XO-CHIP
+        uint32_t size = c8->variant == VARIANT_XOCHIP ? MEMORY_SIZE : CHIP8_MEMORY;
+        c8->decoded = calloc(size, sizeof(DecodedOp));
+        if (c8->decoded == NULL) {
+            return false;
+        }
+        c8->decoded_size = size;
+    }
+
+    if (core == CORE_BLOCK && c8->blocks == NULL) {
+        c8->blocks = calloc(1, sizeof(BlockCache));
+        if (c8->blocks == NULL) {
+            return false;
+        }
+    }
+
+    c8->core = core;
+    return true;
+
+}
+
+void release_cores(Chip8* c8) {
+    free(c8->decoded);
+    c8->decoded = NULL;
+    c8->decoded_size = 0;
+    free(c8->blocks);
+    c8->blocks = NULL;
+    c8->core = CORE_SWITCH;
+}
+
+// Where PC ends up `steps` instructions further round the timer loop the
+// machine is idle in, which goes skip, jump, FX07 and round again.
+static uint16_t timer_loop_pc(const Chip8* c8, uint64_t steps) {
+    uint16_t loop = c8->idle_loop;
+    uint16_t order[3] = {loop + 2, loop + 4, loop};
+    int at = c8->PC == order[0] ? 0 : c8->PC == order[1] ? 1 : 2;
+    return order[(at + steps) % 3];
+}
+
+// Run up to budget instructions on whichever core the machine has selected,
+// built for the machine's quirk profile. With the display wait quirk the run
+// stops early right after a draw so the caller can wait for the next frame.
+// A machine caught in an idle loop gets the rest of its budget skipped and
+// c8->idle says what it's waiting on, it ends up exactly where spinning
+// would have left it. A debugger with anything armed takes the run over
+// instead, see run_debug(). Returns how many instructions ran.
+int run_instructions(Chip8* c8, int budget) {
+
+    Chip8Core core = c8->core;
+#ifdef CHIP8_PROFILE
+    // the profile hooks live in emulate_cycle(), a profiled machine steps
+    if (c8->profile) {
+        core = CORE_SWITCH;
+    }
+#endif
+
+    c8->idle = IDLE_NONE;
+    int executed;
+    if (c8->debug != NULL && debug_armed(c8->debug)) {
+        executed = run_debug(c8, budget);
+    } else if (core == CORE_PREDECODED) {
+        executed = run_predecoded(c8, budget);
+    } else if (core == CORE_BLOCK) {
+        executed = run_block(c8, budget);
+    } else {
+        executed = run_switch(c8, budget);
+    }
+
+    if (c8->idle != IDLE_NONE) {
+        skip_idle_run(c8, budget - executed);
+        executed = budget;
+    }
+    return executed;
+
+}
+
+// A core stopped in an idle loop with `left` instructions of its run still
+// to go, every one of them would only move PC round the loop.
+void skip_idle_run(Chip8* c8, int left) {
+    if (c8->idle == IDLE_TIMER) {
+        c8->PC = timer_loop_pc(c8, left);
+    }
+}
+
+///////////////////////////////
+// EMULATION CYCLE HANDLER   //
+///////////////////////////////
+
+// One 60Hz tick of the delay and sound timers, the end of a frame.
+void tick_timers(Chip8* c8) {
+    PROFILE_FRAME(c8);
+    if (c8->capture != NULL) {
+        capture_frame(c8->capture, c8);
+    }
+    if (c8->delay_timer > 0) {
+        c8->delay_timer -= 1;
+    }
+    if (c8->sound_timer > 0) {
+        c8->sound_timer -= 1;
+    }
+}
+
+// Skip the next frames an idle machine would spend spinning, at most limit of
+// them, leaving it in the state run_headless() would have: timers ticked,
+// and for a timer loop PC moved round it and VX holding what the last
+// frame's FX07 read. The keypad never changes headless, so a machine stuck
+// in FX0A is stuck for good. Returns how many frames it skipped.
+static uint64_t skip_idle_frames(Chip8* c8, uint64_t limit) {
+
+    uint64_t frames = limit;
+    if (c8->idle == IDLE_TIMER) {
+        uint16_t at = c8->idle_loop + 2;
+        uint16_t skip = c8->memory[at & c8->memory_mask] << 8 | c8->memory[(at + 1) & c8->memory_mask];
+        uint8_t x = (skip >> 8) & 0xF;
+        uint8_t nn = skip & 0xFF;
+
+        // every frame FX07 reads the timer again, the first value the skip
+        // fires on ends the loop and that frame has to run for real
+        frames = 0;
+        uint8_t value = c8->delay_timer;
+        while (frames < limit && ((skip >> 12) == 0x3 ? value != nn : value == nn)) {
+            frames++;
+            if (value == 0) {
+                // the timer stays at 0, so does the loop
+                frames = limit;
+                break;
+            }
+            value--;
+        }
+        if (frames == 0) {
+            return 0;
+        }
+        c8->V[x] = c8->delay_timer > frames - 1 ? c8->delay_timer - (frames - 1) : 0;
+        c8->PC = timer_loop_pc(c8, frames * HEADLESS_INSTRUCTIONS);
+    }
+
+    c8->delay_timer = c8->delay_timer > frames ? c8->delay_timer - frames : 0;
+    c8->sound_timer = c8->sound_timer > frames ? c8->sound_timer - frames : 0;
+    // nothing on screen changes while idle, the frames only take time
+    if (c8->capture != NULL) {
+        c8->capture->frame += frames;
+    }
+    return frames;
+
+}
+
+// Finish a frame of a headless run once its instructions ran: tick the timers
+// and, when the machine was left idle, skip the frames after it that would
+// only spin, as many as fit in the instructions and frames the run has left
+// (this frame counts against frames_left). Returns the frames that came to,
+// this one included, every skipped one stands for HEADLESS_INSTRUCTIONS.
+uint64_t end_headless_frame(Chip8* c8, uint64_t instructions_left, uint64_t frames_left) {
+
+    c8->draw_flag = 0;
+    tick_timers(c8);
+    if (c8->idle == IDLE_NONE) {
+        return 1;
+    }
+
+    uint64_t limit = instructions_left / HEADLESS_INSTRUCTIONS;
+    if (limit > frames_left - 1) {
+        limit = frames_left - 1;
+    }
+    return 1 + skip_idle_frames(c8, limit);
+
+}
+
+// Instructions owed to frame n of a run at ips instructions a second, the
+// difference between where the running total should be after it and where
+// it was before it, so 700 ips really is 700 and not 60 * 11.
+uint64_t frame_instructions(uint64_t frame, uint64_t ips) {
+    uint64_t before = frame / FRAME_RATE * ips + frame % FRAME_RATE * ips / FRAME_RATE;
+    uint64_t after = (frame + 1) / FRAME_RATE * ips + (frame + 1) % FRAME_RATE * ips / FRAME_RATE;
+    return after - before;
+}
+
+// Run the interpreter without ever touching SDL, as fast as the host allows.
+// Uses the same 16 instructions per 60Hz tick (and the same display wait) as
+// the windowed loop so a headless run ends in the state you'd see on screen,
+// the timers just tick once per emulated frame instead of once per 16ms.
+// Frames an idle machine would only spin through are skipped, see
+// skip_idle_frames(). Returns the number of instructions executed, frames_run gets the frame count.
+uint64_t run_headless(Chip8* c8, uint64_t max_instructions, uint64_t max_frames, uint64_t* frames_run) {
+
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+
+    while (instructions < max_instructions && frames < max_frames) {
+        uint64_t remaining = max_instructions - instructions;
+        instructions += run_instructions(c8, remaining < HEADLESS_INSTRUCTIONS ? (int)remaining : HEADLESS_INSTRUCTIONS);
+        uint64_t ended = end_headless_frame(c8, max_instructions - instructions, max_frames - frames);
+        instructions += (ended - 1) * HEADLESS_INSTRUCTIONS;
+        frames += ended;
+    }
+
+    if (frames_run) {
+        *frames_run = frames;
+    }
+
+    return instructions;
+
+}
+
+// Print the whole machine state in a plain text form that's easy to diff
+// between runs: the display as rows of '#' and '.', then the registers,
+// then a hex dump of memory 16 bytes to a line. On XO-CHIP's second plane
+// a pixel is '+', '@' when it's lit on both.
+void dump_state(const Chip8* c8) {
+
+    const uint64_t* display = chip8_framebuffer(c8);
+    int width = c8->hires ? HIRES_WIDTH : SCREEN_WIDTH;
+    int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+
+    printf("display:\n");
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            putchar(".#+@"[display_color(display, x, y)]);
+        }
+        putchar('\n');
+    }
+
+    printf("V:");
+    for (int i = 0; i < 16; i++) {
+        printf(" %02X", c8->V[i]);
+    }
+    printf("\nI: %03X PC: %03X stack_idx: %d delay_timer: %d sound_timer: %d\n",
+           c8->I, c8->PC, c8->stack_idx, c8->delay_timer, c8->sound_timer);
+
+    printf("stack:");
+    for (int i = 0; i < 16; i++) {
+        printf(" %03X", c8->stack[i]);
+    }
+
+    if (c8->variant != VARIANT_CHIP8) {
+        printf("\nvariant: %s hires: %d planes: %d pitch: %d rpl:",
+               variant_name(c8->variant), c8->hires, c8->planes, c8->pitch);
+        for (int i = 0; i < 16; i++) {
+            printf(" %02X", c8->rpl[i]);
+        }
+    }
+    if (c8->quirks != variant_quirks(c8->variant)) {
+        printf("\nquirks: %s", quirks_name(c8->quirks));
+    }
+
+    printf("\nmemory:\n");
+    for (int addr = 0; addr <= c8->memory_mask; addr += 16) {
+        printf("%03X:", addr);
+        for (int i = 0; i < 16; i++) {
+            printf(" %02X", c8->memory[addr + i]);
+        }
+        putchar('\n');
+    }
+
+}
+
+bool parse_core(const char* name, Chip8Core* core) {
+    if (strcmp(name, "switch") == 0) {
+        *core = CORE_SWITCH;
+    } else if (strcmp(name, "predecoded") == 0) {
+        *core = CORE_PREDECODED;
+    } else if (strcmp(name, "block") == 0) {
+        *core = CORE_BLOCK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* core_name(Chip8Core core) {
+    switch (core) {
+        case CORE_PREDECODED:
+            return "predecoded";
+        case CORE_BLOCK:
+            return "block";
+        default:
+            return "switch";
+    }
+}
+
+bool parse_variant(const char* name, Chip8Variant* variant) {
+    if (strcmp(name, "chip8") == 0) {
+        *variant = VARIANT_CHIP8;
+    } else if (strcmp(name, "schip") == 0) {
+        *variant = VARIANT_SCHIP;
+    } else if (strcmp(name, "xochip") == 0) {
+        *variant = VARIANT_XOCHIP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* variant_name(Chip8Variant variant) {
+    switch (variant) {
+        case VARIANT_SCHIP:
+            return "schip";
+        case VARIANT_XOCHIP:
+            return "xochip";
+        default:
+            return "chip8";
+    }
+}
+
+// Guess a rom's variant from the usual file extensions, .sc8 for SUPER-CHIP
+// and .xo8 for XO-CHIP, anything else is taken for plain CHIP-8.
+Chip8Variant variant_for_rom(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot && strcasecmp(dot, ".sc8") == 0) {
+        return VARIANT_SCHIP;
+    }
+    if (dot && strcasecmp(dot, ".xo8") == 0) {
+        return VARIANT_XOCHIP;
+    }
+    return VARIANT_CHIP8;
+}
+
+bool parse_quirks(const char* name, Chip8Quirks* quirks) {
+    if (strcmp(name, "vip") == 0) {
+        *quirks = QUIRKS_VIP;
+    } else if (strcmp(name, "chip48") == 0) {
+        *quirks = QUIRKS_CHIP48;
+    } else if (strcmp(name, "schip") == 0) {
+        *quirks = QUIRKS_SCHIP;
+    } else if (strcmp(name, "xochip") == 0) {
+        *quirks = QUIRKS_XOCHIP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* quirks_name(Chip8Quirks quirks) {
+    switch (quirks) {
+        case QUIRKS_CHIP48:
+            return "chip48";
+        case QUIRKS_SCHIP:
+            return "schip";
+        case QUIRKS_XOCHIP:
+            return "xochip";
+        default:
+            return "vip";
+    }
+}
+
+// The profile roms written for a variant usually expect.
+Chip8Quirks variant_quirks(Chip8Variant variant) {
+    switch (variant) {
+        case VARIANT_SCHIP:
+            return QUIRKS_SCHIP;
+        case VARIANT_XOCHIP:
+            return QUIRKS_XOCHIP;
+        default:
+            return QUIRKS_VIP;
+    }
+}
+
+double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
@@ -0,0 +1,591 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "include/chip8.h"
+
+// chip8_conform: the conformance and performance regression suite `ctest`
+// runs. Every case in a manifest is one rom under one quirk profile:
+//
+//     # rom              quirks  frames  hash      mips  pokes
+//     builtin:clipping   vip     60      1A2B3C4D  20
+//     5-quirks.ch8       vip     600     -         20    1FF=01
+//
+// The rom runs headless from reset for that many frames on every core, and
+// the FNV-1a hash of what's left on the display (chip8_display_hash()) has
+// to be the golden one on each of them. Then it runs a fixed number of
+// instructions per core, best of a few, and every core has to manage at
+// least `mips` million instructions a second of the thread's CPU time (0
+// for no floor), so a slower emulate_cycle() fails the suite the same way a
+// wrong pixel does. A hash of '-' hasn't been blessed yet and only gets
+// reported. The profile picks the variant as well (schip and xochip roms
+// get their machine), and pokes are bytes written after loading, for the
+// roms that read a setting from memory instead of asking for a key.
+//
+// "builtin:" roms are generated here, one per quirk regression the
+// interpreter has had (see builtins[]), the rest are files under the roms
+// directory (-d), the Timendus chip8-test-suite in the shipped manifest.
+// Without a roms directory the file cases are skipped. Cases run in
+// parallel, one thread per core, and -b prints the manifest's cases back
+// with the hashes and rates of this build to bless a new golden set.
+
+#define CONFORM_INSTRUCTIONS    2000000ull
+#define CONFORM_REPEATS         3
+#define CONFORM_SEED            1
+#define CONFORM_POKES           8
+#define CONFORM_LINE            512
+
+static const Chip8Core conform_cores[] = {CORE_SWITCH, CORE_PREDECODED, CORE_BLOCK};
+
+#define CONFORM_CORES (sizeof(conform_cores) / sizeof(conform_cores[0]))
+
+typedef struct Rom {
+    uint8_t data[MEMORY_SIZE - 0x200];
+    size_t size;
+} Rom;
+
+// The keypad from `frame` on.
+typedef struct KeyEvent {
+    uint64_t frame;
+    uint16_t keys;
+} KeyEvent;
+
+typedef struct Builtin {
+    const char* name;
+    void (*build)(Rom* rom);
+    KeyEvent keys[2];
+    int key_count;
+} Builtin;
+
+static void emit(Rom* rom, uint16_t op) {
+    rom->data[rom->size++] = op >> 8;
+    rom->data[rom->size++] = op & 0xFF;
+}
+
+static void emit_all(Rom* rom, const uint16_t* ops, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        emit(rom, ops[i]);
+    }
+}
+
+// Draw the 3 BCD digits of V0-V2 (as F265 leaves them) at (V3, V4).
+static void emit_digits(Rom* rom) {
+    static const uint16_t digits[] = {
+        0xF029, 0xD345, 0x7305, 0xF129, 0xD345, 0x7305, 0xF229, 0xD345,
+    };
+    emit_all(rom, digits, sizeof(digits) / sizeof(digits[0]));
+}
+
+// A 4 row block over the bottom right corner, which VIP and SCHIP clip and
+// XO-CHIP wraps round to the other corners, and one drawn from x = 66,
+// which starts at x = 2 everywhere.
+static void build_clipping(Rom* rom) {
+    static const uint16_t ops[] = {
+        0xA212, 0x603C, 0x611E, 0xD014,
+        0x6042, 0x6101, 0xD014,
+        0x120E, 0x0000,
+        0xFFFF, 0xFFFF,
+    };
+    emit_all(rom, ops, sizeof(ops) / sizeof(ops[0]));
+}
+
+// 100 draws timed on the delay timer, shown as BCD. With the display wait
+// every draw takes a frame of its own, without it 25 frames do them all.
+static void build_display_wait(Rom* rom) {
+    static const uint16_t ops[] = {
+        0x60FF, 0xF015, 0xA230, 0x6100, 0x6200,
+        0xD221, 0x7101, 0x3164, 0x120A,
+        0xF307, 0xA300, 0xF333, 0xF265, 0x6300, 0x6408,
+    };
+    emit_all(rom, ops, sizeof(ops) / sizeof(ops[0]));
+    emit_digits(rom);
+    emit(rom, 0x1000 | (0x200 + rom->size));
+    emit(rom, 0x8000);
+}
+
+// FX0A only hands the key over once it's released again. Key 5 is held from
+// frame 10 to 30, the key and the delay timer when FX0A returned are shown.
+static void build_fx0a_release(Rom* rom) {
+    static const uint16_t ops[] = {
+        0x60FF, 0xF015, 0xF50A, 0xF107, 0xA300, 0xF133, 0xF265,
+        0x6300, 0x6400, 0xF529, 0xD345, 0x7305,
+    };
+    emit_all(rom, ops, sizeof(ops) / sizeof(ops[0]));
+    emit_digits(rom);
+    emit(rom, 0x1000 | (0x200 + rom->size));
+}
+
+// The BCD digits of a few values that once came out wrong, two columns of
+// rows of three digits.
+static void build_bcd(Rom* rom) {
+    static const uint8_t values[] = {0, 9, 10, 99, 100, 137, 200, 255};
+    for (size_t i = 0; i < sizeof(values); i++) {
+        emit(rom, 0x6000 | values[i]);
+        emit(rom, 0xA3F0);
+        emit(rom, 0xF033);
+        emit(rom, 0xF265);
+        emit(rom, 0x6300 | (i / 4) * 20);
+        emit(rom, 0x6400 | (i % 4) * 7);
+        emit_digits(rom);
+    }
+    emit(rom, 0x1000 | (0x200 + rom->size));
+}
+
+static const Builtin builtins[] = {
+    {"builtin:clipping", build_clipping, {{0, 0}}, 0},
+    {"builtin:display-wait", build_display_wait, {{0, 0}}, 0},
+    {"builtin:fx0a-release", build_fx0a_release, {{10, 1 << 5}, {30, 0}}, 2},
+    {"builtin:bcd", build_bcd, {{0, 0}}, 0},
+};
+
+#define BUILTIN_COUNT (sizeof(builtins) / sizeof(builtins[0]))
+
+typedef struct Poke {
+    uint16_t addr;
+    uint8_t value;
+} Poke;
+
+typedef enum CaseStatus {
+    CASE_PASS,
+    CASE_FAIL,
+    CASE_SKIP,
+    CASE_UNBLESSED,
+} CaseStatus;
+
+typedef struct Case {
+    // from the manifest
+    int line;
+    char rom[256];
+    char pokes_text[64];
+    Chip8Quirks quirks;
+    uint64_t frames;
+    bool blessed;
+    uint32_t golden;
+    double min_mips;
+    Poke pokes[CONFORM_POKES];
+    int poke_count;
+
+    // what running it came to
+    CaseStatus status;
+    char why[160];
+    uint32_t hash[CONFORM_CORES];
+    double mips[CONFORM_CORES];
+} Case;
+
+typedef struct Suite {
+    Case* cases;
+    int count;
+    const char* roms;
+    uint64_t instructions;
+    bool check_mips;
+    atomic_int next;
+} Suite;
+
+static bool parse_pokes(Case* c, const char* text) {
+    snprintf(c->pokes_text, sizeof(c->pokes_text), "%s", text);
+    while (*text) {
+        unsigned addr;
+        unsigned value;
+        int used;
+        if (c->poke_count == CONFORM_POKES
+                || sscanf(text, "%x=%x%n", &addr, &value, &used) != 2 || addr >= MEMORY_SIZE || value > 0xFF) {
+            return false;
+        }
+        c->pokes[c->poke_count].addr = (uint16_t)addr;
+        c->pokes[c->poke_count].value = (uint8_t)value;
+        c->poke_count++;
+        text += used;
+        if (*text == ',') {
+            text++;
+        } else if (*text) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One manifest line into c, false when it isn't a case. Anything from a
+// '#' on is a comment.
+static bool parse_case(Case* c, char* line) {
+
+    char* fields[6];
+    int count = 0;
+    for (char* field = strtok(line, " \t\r\n"); field && *field != '#' && count < 6; field = strtok(NULL, " \t\r\n")) {
+        fields[count++] = field;
+    }
+    if (count < 5 || strlen(fields[0]) >= sizeof(c->rom) || !parse_quirks(fields[1], &c->quirks)) {
+        return false;
+    }
+
+    snprintf(c->rom, sizeof(c->rom), "%s", fields[0]);
+    char* end;
+    c->frames = strtoull(fields[2], &end, 10);
+    if (*end || c->frames == 0) {
+        return false;
+    }
+    c->blessed = strcmp(fields[3], "-") != 0;
+    if (c->blessed) {
+        unsigned long golden = strtoul(fields[3], &end, 16);
+        if (*end || golden > UINT32_MAX) {
+            return false;
+        }
+        c->golden = (uint32_t)golden;
+    }
+    c->min_mips = strtod(fields[4], &end);
+    if (*end || c->min_mips < 0) {
+        return false;
+    }
+    return count < 6 || strcmp(fields[5], "-") == 0 || parse_pokes(c, fields[5]);
+
+}
+
+// Read the cases out of the manifest at path, NULL with an error printed
+// when it can't be read or has a line that isn't a case.
+static Case* load_manifest(const char* path, int* count) {
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        error("[FAILED] Could not read manifest %s\n", path);
+        return NULL;
+    }
+
+    Case* cases = NULL;
+    int capacity = 0;
+    char line[CONFORM_LINE];
+    int number = 0;
+    *count = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        char* at = line + strspn(line, " \t");
+        if (*at == '#' || *at == '\n' || *at == '\r' || *at == '\0') {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            Case* grown = realloc(cases, capacity * sizeof(Case));
+            if (grown == NULL) {
+                error("[FAILED] Out of memory reading %s\n", path);
+                free(cases);
+                fclose(file);
+                return NULL;
+            }
+            cases = grown;
+        }
+        Case* c = &cases[*count];
+        memset(c, 0, sizeof(Case));
+        c->line = number;
+        if (!parse_case(c, at)) {
+            error("[FAILED] %s:%d is not a case (rom quirks frames hash mips [pokes])\n", path, number);
+            free(cases);
+            fclose(file);
+            return NULL;
+        }
+        (*count)++;
+    }
+
+    fclose(file);
+    return cases;
+
+}
+
+static const Builtin* find_builtin(const char* name) {
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (strcmp(builtins[i].name, name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+static Chip8Variant profile_variant(Chip8Quirks quirks) {
+    switch (quirks) {
+        case QUIRKS_SCHIP:
+            return VARIANT_SCHIP;
+        case QUIRKS_XOCHIP:
+            return VARIANT_XOCHIP;
+        default:
+            return VARIANT_CHIP8;
+    }
+}
+
+// c's rom from reset on c8, pokes and all. False when it doesn't fit or
+// there's no memory for the variant.
+static bool reset_case(Chip8* c8, const Case* c, const Rom* rom) {
+    if (!chip8_set_variant(c8, profile_variant(c->quirks))) {
+        return false;
+    }
+    chip8_set_quirks(c8, c->quirks);
+    if (load_rom_data(c8, rom->data, rom->size)) {
+        return false;
+    }
+    for (int i = 0; i < c->poke_count; i++) {
+        c8->memory[c->pokes[i].addr & c8->memory_mask] = c->pokes[i].value;
+    }
+    return true;
+}
+
+// Run up to max_instructions or max_frames from where c8 is, the keypad
+// following the builtin's key events. Returns the instructions run.
+static uint64_t run_keyed(Chip8* c8, const Builtin* builtin, uint64_t max_instructions, uint64_t max_frames) {
+    uint64_t instructions = 0;
+    uint64_t frame = 0;
+    int event = 0;
+    while (instructions < max_instructions && frame < max_frames) {
+        while (builtin && event < builtin->key_count && builtin->keys[event].frame <= frame) {
+            chip8_set_keys(c8, builtin->keys[event++].keys);
+        }
+        uint64_t until = max_frames;
+        if (builtin && event < builtin->key_count && builtin->keys[event].frame < until) {
+            until = builtin->keys[event].frame;
+        }
+        uint64_t ran;
+        instructions += run_headless(c8, max_instructions - instructions, until - frame, &ran);
+        frame += ran;
+    }
+    return instructions;
+}
+
+static double thread_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Best rate of CONFORM_REPEATS runs from reset, in CPU time so a loaded
+// machine only slows the suite down rather than failing it.
+static double measure_mips(Chip8* c8, const Case* c, const Rom* rom, const Builtin* builtin, uint64_t instructions) {
+    double best = 0;
+    for (int r = 0; r < CONFORM_REPEATS; r++) {
+        reset_case(c8, c, rom);
+        double start = thread_seconds();
+        uint64_t ran = run_keyed(c8, builtin, instructions, UINT64_MAX);
+        double seconds = thread_seconds() - start;
+        double mips = ran / (seconds > 0 ? seconds : 1e-9) / 1e6;
+        if (mips > best) {
+            best = mips;
+        }
+    }
+    return best;
+}
+
+static bool read_rom(const char* path, Rom* rom) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    rom->size = fread(rom->data, 1, sizeof(rom->data), file);
+    bool ok = !ferror(file) && fgetc(file) == EOF;
+    fclose(file);
+    return ok;
+}
+
+static void run_case(Suite* suite, Case* c, Chip8* c8) {
+
+    Rom* rom = malloc(sizeof(Rom));
+    if (rom == NULL) {
+        c->status = CASE_FAIL;
+        snprintf(c->why, sizeof(c->why), "out of memory");
+        return;
+    }
+    rom->size = 0;
+
+    const Builtin* builtin = NULL;
+    if (strncmp(c->rom, "builtin:", 8) == 0) {
+        builtin = find_builtin(c->rom);
+        if (builtin == NULL) {
+            c->status = CASE_FAIL;
+            snprintf(c->why, sizeof(c->why), "no such builtin rom");
+            free(rom);
+            return;
+        }
+        builtin->build(rom);
+    } else {
+        char path[1024];
+        if (suite->roms == NULL) {
+            c->status = CASE_SKIP;
+            snprintf(c->why, sizeof(c->why), "no roms directory");
+            free(rom);
+            return;
+        }
+        snprintf(path, sizeof(path), "%s/%s", suite->roms, c->rom);
+        if (!read_rom(path, rom)) {
+            c->status = CASE_SKIP;
+            snprintf(c->why, sizeof(c->why), "could not read %.*s", (int)sizeof(c->why) - 16, path);
+            free(rom);
+            return;
+        }
+    }
+
+    c->status = c->blessed ? CASE_PASS : CASE_UNBLESSED;
+    for (size_t i = 0; i < CONFORM_CORES; i++) {
+        if (!select_core(c8, conform_cores[i]) || !reset_case(c8, c, rom)) {
+            c->status = CASE_FAIL;
+            snprintf(c->why, sizeof(c->why), "rom does not load on the %s core", core_name(conform_cores[i]));
+            break;
+        }
+        run_keyed(c8, builtin, UINT64_MAX, c->frames);
+        c->hash[i] = chip8_display_hash(c8);
+        if (c->blessed && c->hash[i] != c->golden && c->status != CASE_FAIL) {
+            c->status = CASE_FAIL;
+            snprintf(c->why, sizeof(c->why), "%s core's display is %08X, expected %08X",
+                     core_name(conform_cores[i]), c->hash[i], c->golden);
+        }
+        c->mips[i] = measure_mips(c8, c, rom, builtin, suite->instructions);
+        if (suite->check_mips && c->mips[i] < c->min_mips && c->status != CASE_FAIL) {
+            c->status = CASE_FAIL;
+            snprintf(c->why, sizeof(c->why), "%s core ran %.1f MIPS, the floor is %.1f",
+                     core_name(conform_cores[i]), c->mips[i], c->min_mips);
+        }
+    }
+
+    free(rom);
+
+}
+
+static void* conform_worker(void* arg) {
+
+    Suite* suite = arg;
+    Chip8* c8 = chip8_create(CORE_SWITCH, CONFORM_SEED);
+    int index;
+    while ((index = atomic_fetch_add(&suite->next, 1)) < suite->count) {
+        Case* c = &suite->cases[index];
+        if (c8 == NULL) {
+            c->status = CASE_FAIL;
+            snprintf(c->why, sizeof(c->why), "out of memory");
+            continue;
+        }
+        run_case(suite, c, c8);
+    }
+    chip8_destroy(c8);
+    return NULL;
+
+}
+
+static void print_result(const Case* c) {
+    static const char* labels[] = {"[PASS]", "[FAILED]", "[SKIP]", "[UNBLESSED]"};
+    printf("%-11s %-24s %-6s %-10s", labels[c->status], c->rom, quirks_name(c->quirks),
+           c->poke_count ? c->pokes_text : "-");
+    if (c->status != CASE_SKIP) {
+        printf(" %08X", c->hash[0]);
+        for (size_t i = 0; i < CONFORM_CORES; i++) {
+            printf(" %s %.0f", core_name(conform_cores[i]), c->mips[i]);
+        }
+    }
+    if (c->why[0]) {
+        printf(": %s", c->why);
+    }
+    putchar('\n');
+}
+
+// The case as a manifest line with this build's hash, and its rates to pick
+// a floor from.
+static void print_blessed(const Case* c) {
+    if (c->status == CASE_SKIP) {
+        printf("# %s %s skipped: %s\n", c->rom, quirks_name(c->quirks), c->why);
+        return;
+    }
+    double slowest = c->mips[0];
+    for (size_t i = 1; i < CONFORM_CORES; i++) {
+        slowest = c->mips[i] < slowest ? c->mips[i] : slowest;
+    }
+    printf("%-24s %-6s %-7llu %08X  %-5g %s    # slowest core %.0f MIPS\n", c->rom, quirks_name(c->quirks),
+           (unsigned long long)c->frames, c->hash[0], c->min_mips, c->poke_count ? c->pokes_text : "-", slowest);
+}
+
+static void usage(void) {
+    error("Usage: chip8_conform [-d roms] [-j threads] [-n instructions] [-M] [-b] manifest\n"
+          "  -d roms          directory the manifest's rom files are in (default: skip them)\n"
+          "  -j threads       cases run at once (default: one per core)\n"
+          "  -n instructions  instructions per rate measurement (default 2000000)\n"
+          "  -M               don't enforce the MIPS floors (e.g. for a debug build)\n"
+          "  -b               bless: print the cases back with this build's hashes\n");
+}
+
+int main(int argc, char** argv) {
+
+    Suite suite = {.instructions = CONFORM_INSTRUCTIONS, .check_mips = true};
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool bless = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:j:n:Mb")) != -1) {
+        switch (opt) {
+            case 'd':
+                suite.roms = *optarg ? optarg : NULL;
+                break;
+            case 'j':
+                threads = atol(optarg);
+                break;
+            case 'n':
+                suite.instructions = strtoull(optarg, NULL, 10);
+                break;
+            case 'M':
+                suite.check_mips = false;
+                break;
+            case 'b':
+                bless = true;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return 2;
+    }
+
+    suite.cases = load_manifest(argv[optind], &suite.count);
+    if (suite.cases == NULL) {
+        return 2;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > suite.count) {
+        threads = suite.count > 0 ? suite.count : 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_init(&suite.next, 0);
+    pthread_t* workers = malloc(threads * sizeof(pthread_t));
+    long started = 0;
+    while (workers && started < threads && !pthread_create(&workers[started], NULL, conform_worker, &suite)) {
+        started++;
+    }
+    if (started == 0) {
+        // no threads to be had, run them all on this one
+        conform_worker(&suite);
+    }
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    int counts[4] = {0};
+    for (int i = 0; i < suite.count; i++) {
+        Case* c = &suite.cases[i];
+        counts[c->status]++;
+        if (bless) {
+            print_blessed(c);
+        } else {
+            print_result(c);
+        }
+    }
+    if (!bless) {
+        printf("%s %d passed, %d failed, %d skipped, %d unblessed in %.2fs\n",
+               counts[CASE_FAIL] ? "[FAILED]" : "[OK]", counts[CASE_PASS], counts[CASE_FAIL],
+               counts[CASE_SKIP], counts[CASE_UNBLESSED], seconds_since(&start));
+    }
+
+    free(suite.cases);
+    return counts[CASE_FAIL] ? 1 : 0;
+
+}
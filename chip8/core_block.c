@@ -0,0 +1,228 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/decode.h"
+#include "include/ops.h"
+#include "include/block.h"
+
+// Basic-block core, see include/block.h for what a block is. Running the
+// blocks is in core_block.inc, built once per quirk profile.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_COMPUTED_GOTO 1
+#endif
+
+// pages one bit of the dirty masks stands for, see DIRTY_PAGE()
+#define PAGE_COUNT 64
+
+// Only the first `addresses` slots can be in use, the machine's memory size.
+void block_cache_flush(BlockCache* cache, uint32_t addresses) {
+    memset(cache->slot, 0, addresses * sizeof(cache->slot[0]));
+    cache->used = 0;
+    cache->code_pages = 0;
+    cache->resume = false;
+}
+
+static inline uint16_t fetch(const Chip8* c8, uint16_t pc) {
+    return c8->memory[pc & c8->memory_mask] << 8 | c8->memory[(pc + 1) & c8->memory_mask];
+}
+
+static inline bool is_skip(uint8_t handler) {
+    switch (handler) {
+        case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0:
+        case OP_EX9E: case OP_EXA1:
+            return true;
+    }
+    return false;
+}
+
+// Anything that doesn't simply carry on with the next instruction, or that
+// stores to memory, finishes the block.
+static inline bool ends_block(uint8_t handler) {
+    switch (handler) {
+        case OP_00EE: case OP_0NNN: case OP_1NNN: case OP_2NNN: case OP_BNNN:
+        case OP_8_BAD: case OP_E_BAD: case OP_F_BAD:
+        case OP_DXYN: case OP_FX0A: case OP_FX33: case OP_FX55:
+        case OP_00FD: case OP_F000: case OP_5XY2:
+            return true;
+    }
+    return is_skip(handler);
+}
+
+static Block* translate(BlockCache* cache, const Chip8* c8, uint16_t start) {
+
+    if (cache->used == BLOCK_POOL) {
+        block_cache_flush(cache, c8->memory_mask + 1);
+    }
+
+    Block* block = &cache->pool[cache->used++];
+    cache->slot[start] = cache->used;
+    block->op_count = 0;
+
+    uint16_t pc = start;
+    int instructions = 0;
+
+    while (instructions < BLOCK_MAX_INSTRUCTIONS) {
+        DecodedOp d;
+        decode_op(fetch(c8, pc), c8->variant, &d);
+
+        BlockOp* prev = block->op_count ? &block->ops[block->op_count - 1] : NULL;
+
+        if ((d.handler == OP_6XNN || d.handler == OP_7XNN)
+                && prev && (prev->kind == BOP_SET || prev->kind == BOP_ADD) && prev->x == d.x) {
+            // 6XNN throws away whatever the run did so far, 7XNN just adds on
+            if (d.handler == OP_6XNN) {
+                prev->kind = BOP_SET;
+                prev->nn = d.nn;
+            } else {
+                prev->nn += d.nn;
+            }
+            prev->len++;
+            pc += 2;
+            instructions++;
+            continue;
+        }
+
+        BlockOp* op = &block->ops[block->op_count++];
+        op->kind = d.handler;
+        op->cond = 0;
+        op->x = d.x;
+        op->y = d.y;
+        op->n = d.n;
+        op->nn = d.nn;
+        op->nnn = d.nnn;
+        op->op = d.op;
+        op->len = 1;
+        pc += 2;
+        instructions++;
+
+        if (d.handler == OP_6XNN) {
+            op->kind = BOP_SET;
+        } else if (d.handler == OP_7XNN) {
+            op->kind = BOP_ADD;
+        } else if (is_skip(d.handler) && instructions < BLOCK_MAX_INSTRUCTIONS
+                   && (fetch(c8, pc) >> 12) == 0x1) {
+            // skip over a jump: the pair either falls into PC + 4 or takes the jump
+            op->kind = BOP_BRANCH;
+            op->cond = d.handler;
+            op->nnn = fetch(c8, pc) & 0x0FFF;
+            op->len = 2;
+            pc += 2;
+            instructions++;
+            break;
+        }
+
+        if (ends_block(d.handler)) {
+            break;
+        }
+    }
+
+    // Every page the block read from, so a store to any of them retires it.
+    block->pages = 0;
+    for (uint16_t addr = start; addr != pc; addr += 2) {
+        block->pages |= 1ull << DIRTY_PAGE(addr & c8->memory_mask);
+        block->pages |= 1ull << DIRTY_PAGE((addr + 1) & c8->memory_mask);
+    }
+    cache->code_pages |= block->pages;
+
+    return block;
+
+}
+
+// Drop every block translated from a page that's been written since we last
+// looked. code_pages only ever grows until the next flush, so it can claim a
+// page still holds code after its blocks are gone, that just costs a scan
+// that finds nothing. A block covers at most 64 bytes, so only blocks starting in the
+// dirty page or the one before it can overlap it. With XO-CHIP's memory every
+// page 4KB apart shares the bit, so all of them get the same scan.
+static void retire_dirty(BlockCache* cache, Chip8* c8) {
+
+    uint64_t dirty = c8->dirty_pages & cache->code_pages;
+    c8->dirty_pages = 0;
+    if (dirty == 0) {
+        return;
+    }
+
+    if (cache->resume && (cache->pool[cache->resume_block].pages & dirty)) {
+        cache->resume = false;
+    }
+
+    uint16_t mask = c8->memory_mask;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (!(dirty & (1ull << page))) {
+            continue;
+        }
+        for (int alias = page << BLOCK_PAGE_SHIFT; alias <= mask; alias += PAGE_COUNT << BLOCK_PAGE_SHIFT) {
+            int first = alias - (1 << BLOCK_PAGE_SHIFT);
+            int last = alias + (1 << BLOCK_PAGE_SHIFT) - 1;
+            for (int addr = first; addr <= last; addr++) {
+                uint16_t pc = addr & mask;
+                uint16_t slot = cache->slot[pc];
+                if (slot && (cache->pool[slot - 1].pages & dirty)) {
+                    cache->slot[pc] = 0;
+                }
+            }
+        }
+    }
+
+}
+
+static inline bool skip_taken(const Chip8* c8, const BlockOp* op) {
+    switch (op->cond) {
+        case OP_3XNN: return c8->V[op->x] == op->nn;
+        case OP_4XNN: return c8->V[op->x] != op->nn;
+        case OP_5XY0: return c8->V[op->x] == c8->V[op->y];
+        case OP_9XY0: return op->n == 0 && c8->V[op->x] != c8->V[op->y];
+        case OP_EX9E: return c8->keypad[c8->V[op->x] & 0xF];
+        case OP_EXA1: return !c8->keypad[c8->V[op->x] & 0xF];
+    }
+    return false;
+}
+
+#define CORE_QUIRKS     QUIRKS_VIP
+#define CORE_NAME(name) name##_vip
+#include "core_block.inc"
+
+#define CORE_QUIRKS     QUIRKS_CHIP48
+#define CORE_NAME(name) name##_chip48
+#include "core_block.inc"
+
+#define CORE_QUIRKS     QUIRKS_SCHIP
+#define CORE_NAME(name) name##_schip
+#include "core_block.inc"
+
+#define CORE_QUIRKS     QUIRKS_XOCHIP
+#define CORE_NAME(name) name##_xochip
+#include "core_block.inc"
+
+#define CORE_QUIRKS     (QUIRKS_VIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_vip_xo
+#include "core_block.inc"
+
+#define CORE_QUIRKS     (QUIRKS_CHIP48 | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_chip48_xo
+#include "core_block.inc"
+
+#define CORE_QUIRKS     (QUIRKS_SCHIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_schip_xo
+#include "core_block.inc"
+
+#define CORE_QUIRKS     (QUIRKS_XOCHIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_xochip_xo
+#include "core_block.inc"
+
+int run_block(Chip8* c8, int budget) {
+    switch (core_profile(c8)) {
+        case QUIRKS_CHIP48: return run_block_chip48(c8, budget);
+        case QUIRKS_SCHIP: return run_block_schip(c8, budget);
+        case QUIRKS_XOCHIP: return run_block_xochip(c8, budget);
+        case QUIRKS_VIP | QUIRKS_XO_VARIANT: return run_block_vip_xo(c8, budget);
+        case QUIRKS_CHIP48 | QUIRKS_XO_VARIANT: return run_block_chip48_xo(c8, budget);
+        case QUIRKS_SCHIP | QUIRKS_XO_VARIANT: return run_block_schip_xo(c8, budget);
+        case QUIRKS_XOCHIP | QUIRKS_XO_VARIANT: return run_block_xochip_xo(c8, budget);
+        default: return run_block_vip(c8, budget);
+    }
+}
@@ -0,0 +1,68 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "include/chip8.h"
+#include "include/decode.h"
+#include "include/ops.h"
+#include "include/trace.h"
+
+// Pre-decoded, indirect-threaded core.
+//
+// Every address gets decoded the first time it runs and the DecodedOp stays
+// in c8->decoded until a store to memory (see mem_written()) overwrites one
+// of its two bytes. Execution then never looks at the opcode again: each
+// handler does its work and jumps straight to the handler of the next
+// instruction through a label table, so there's no shared dispatch switch
+// for the branch predictor to choke on. Compilers without computed goto get
+// the same body as a plain switch in a loop. The body is in
+// core_predecoded.inc, built once per quirk profile.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_COMPUTED_GOTO 1
+#endif
+
+#define CORE_QUIRKS     QUIRKS_VIP
+#define CORE_NAME(name) name##_vip
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     QUIRKS_CHIP48
+#define CORE_NAME(name) name##_chip48
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     QUIRKS_SCHIP
+#define CORE_NAME(name) name##_schip
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     QUIRKS_XOCHIP
+#define CORE_NAME(name) name##_xochip
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     (QUIRKS_VIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_vip_xo
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     (QUIRKS_CHIP48 | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_chip48_xo
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     (QUIRKS_SCHIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_schip_xo
+#include "core_predecoded.inc"
+
+#define CORE_QUIRKS     (QUIRKS_XOCHIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_xochip_xo
+#include "core_predecoded.inc"
+
+int run_predecoded(Chip8* c8, int budget) {
+    switch (core_profile(c8)) {
+        case QUIRKS_CHIP48: return run_predecoded_chip48(c8, budget);
+        case QUIRKS_SCHIP: return run_predecoded_schip(c8, budget);
+        case QUIRKS_XOCHIP: return run_predecoded_xochip(c8, budget);
+        case QUIRKS_VIP | QUIRKS_XO_VARIANT: return run_predecoded_vip_xo(c8, budget);
+        case QUIRKS_CHIP48 | QUIRKS_XO_VARIANT: return run_predecoded_chip48_xo(c8, budget);
+        case QUIRKS_SCHIP | QUIRKS_XO_VARIANT: return run_predecoded_schip_xo(c8, budget);
+        case QUIRKS_XOCHIP | QUIRKS_XO_VARIANT: return run_predecoded_xochip_xo(c8, budget);
+        default: return run_predecoded_vip(c8, budget);
+    }
+}
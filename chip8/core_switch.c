@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "include/chip8.h"
+#include "include/decode.h"
+#include "include/trace.h"
+#include "include/profile.h"
+#include "include/ops.h"
+
+// The plain switch core, built once per quirk profile (and again per profile
+// for XO-CHIP machines) from core_switch.inc.
+
+
+// The SUPER-CHIP and XO-CHIP instructions for emulate_cycle(), the ones the
+// base CHIP-8 switch doesn't know. Kept out of the switch so plain CHIP-8
+// roms don't pay for them on every instruction, and decoded with decode_handler()
+// so the variant checks are the same as the other cores'.
+static void emulate_extended(Chip8* c8, uint16_t op) {
+
+    uint8_t X = (op & 0x0F00) >> 8;
+    uint8_t Y = (op & 0x00F0) >> 4;
+    uint8_t N = op & 0x000F;
+
+    switch (decode_handler(op, c8->variant)) {
+        case OP_00CN: op_00cn(c8, N); break;
+        case OP_00DN: op_00dn(c8, N); break;
+        case OP_00FB: op_00fb(c8); break;
+        case OP_00FC: op_00fc(c8); break;
+        case OP_00FD: op_00fd(c8); break;
+        case OP_00FE: op_00fe_00ff(c8, false); break;
+        case OP_00FF: op_00fe_00ff(c8, true); break;
+        case OP_5XY2: op_5xy2(c8, X, Y); break;
+        case OP_5XY3: op_5xy3(c8, X, Y); break;
+        case OP_F000: op_f000(c8); break;
+        case OP_FN01: op_fn01(c8, X); break;
+        case OP_F002: op_f002(c8); break;
+        case OP_FX30: op_fx30(c8, X); break;
+        case OP_FX3A: op_fx3a(c8, X); break;
+        case OP_FX75: op_fx75(c8, X); break;
+        case OP_FX85: op_fx85(c8, X); break;
+        default: op_unknown(c8, op); break;
+    }
+
+}
+
+#define CORE_QUIRKS     QUIRKS_VIP
+#define CORE_NAME(name) name##_vip
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     QUIRKS_CHIP48
+#define CORE_NAME(name) name##_chip48
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     QUIRKS_SCHIP
+#define CORE_NAME(name) name##_schip
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     QUIRKS_XOCHIP
+#define CORE_NAME(name) name##_xochip
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     (QUIRKS_VIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_vip_xo
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     (QUIRKS_CHIP48 | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_chip48_xo
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     (QUIRKS_SCHIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_schip_xo
+#include "core_switch.inc"
+
+#define CORE_QUIRKS     (QUIRKS_XOCHIP | QUIRKS_XO_VARIANT)
+#define CORE_NAME(name) name##_xochip_xo
+#include "core_switch.inc"
+
+// Run one instruction under the machine's profile, for whoever has to single
+// step (traced and profiled machines, the block core's leftovers). Returns true
+// when the run has to stop for the frame, a draw under the display wait quirk.
+bool emulate_cycle(Chip8* c8) {
+    switch (core_profile(c8)) {
+        case QUIRKS_CHIP48: return step_chip48(c8);
+        case QUIRKS_SCHIP: return step_schip(c8);
+        case QUIRKS_XOCHIP: return step_xochip(c8);
+        case QUIRKS_VIP | QUIRKS_XO_VARIANT: return step_vip_xo(c8);
+        case QUIRKS_CHIP48 | QUIRKS_XO_VARIANT: return step_chip48_xo(c8);
+        case QUIRKS_SCHIP | QUIRKS_XO_VARIANT: return step_schip_xo(c8);
+        case QUIRKS_XOCHIP | QUIRKS_XO_VARIANT: return step_xochip_xo(c8);
+        default: return step_vip(c8);
+    }
+}
+
+// The profile is picked once per run, the loop itself never looks at it.
+int run_switch(Chip8* c8, int budget) {
+    switch (core_profile(c8)) {
+        case QUIRKS_CHIP48: return run_switch_chip48(c8, budget);
+        case QUIRKS_SCHIP: return run_switch_schip(c8, budget);
+        case QUIRKS_XOCHIP: return run_switch_xochip(c8, budget);
+        case QUIRKS_VIP | QUIRKS_XO_VARIANT: return run_switch_vip_xo(c8, budget);
+        case QUIRKS_CHIP48 | QUIRKS_XO_VARIANT: return run_switch_chip48_xo(c8, budget);
+        case QUIRKS_SCHIP | QUIRKS_XO_VARIANT: return run_switch_schip_xo(c8, budget);
+        case QUIRKS_XOCHIP | QUIRKS_XO_VARIANT: return run_switch_xochip_xo(c8, budget);
+        default: return run_switch_vip(c8, budget);
+    }
+}
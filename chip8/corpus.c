@@ -0,0 +1,373 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "include/chip8.h"
+#include "include/corpus.h"
+
+typedef struct CorpusBacking {
+    struct CorpusBacking* next;
+    void* base;
+    size_t size;
+    bool mapped;
+} CorpusBacking;
+
+// A rom found while walking a directory, read once the walk is done.
+typedef struct Pending {
+    char* path;
+    uint32_t size;
+} Pending;
+
+typedef struct PendingList {
+    Pending* items;
+    int count;
+    int capacity;
+} PendingList;
+
+void corpus_init(Corpus* corpus) {
+    memset(corpus, 0, sizeof(Corpus));
+}
+
+void corpus_free(Corpus* corpus) {
+    CorpusBacking* backing = corpus->backing;
+    while (backing) {
+        CorpusBacking* next = backing->next;
+        if (backing->mapped) {
+            munmap(backing->base, backing->size);
+        } else {
+            free(backing->base);
+        }
+        free(backing);
+        backing = next;
+    }
+    free(corpus->roms);
+    corpus_init(corpus);
+}
+
+static bool keep_backing(Corpus* corpus, void* base, size_t size, bool mapped) {
+    CorpusBacking* backing = malloc(sizeof(CorpusBacking));
+    if (backing == NULL) {
+        return false;
+    }
+    backing->base = base;
+    backing->size = size;
+    backing->mapped = mapped;
+    backing->next = corpus->backing;
+    corpus->backing = backing;
+    return true;
+}
+
+static bool push_rom(Corpus* corpus, const char* name, const uint8_t* data, uint32_t size) {
+    if (corpus->count == corpus->capacity) {
+        int capacity = corpus->capacity ? corpus->capacity * 2 : 64;
+        CorpusRom* roms = realloc(corpus->roms, capacity * sizeof(CorpusRom));
+        if (roms == NULL) {
+            return false;
+        }
+        corpus->roms = roms;
+        corpus->capacity = capacity;
+    }
+    corpus->roms[corpus->count++] = (CorpusRom){name, data, size};
+    return true;
+}
+
+static bool read_header(int fd, CorpusHeader* header) {
+    return pread(fd, header, sizeof(*header), 0) == (ssize_t)sizeof(*header)
+           && memcmp(header->magic, CORPUS_MAGIC, sizeof(header->magic)) == 0;
+}
+
+// Map the whole file and point views into it, the index is the only part
+// that gets touched here.
+static bool add_packed(Corpus* corpus, int fd, size_t file_size) {
+
+    uint8_t* base = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    if (!keep_backing(corpus, base, file_size, true)) {
+        munmap(base, file_size);
+        return false;
+    }
+
+    CorpusHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (header.version != CORPUS_VERSION
+        || header.count > (file_size - sizeof(header)) / sizeof(CorpusEntry)) {
+        return false;
+    }
+
+    const CorpusEntry* entries = (const CorpusEntry*)(base + sizeof(header));
+    for (uint32_t i = 0; i < header.count; i++) {
+        CorpusEntry entry;
+        memcpy(&entry, &entries[i], sizeof(entry));
+        if (entry.size > CORPUS_MAX_ROM || entry.offset > file_size
+            || entry.size > file_size - entry.offset || entry.name_offset >= file_size
+            || memchr(base + entry.name_offset, '\0', file_size - entry.name_offset) == NULL) {
+            corpus->rejected++;
+            continue;
+        }
+        if (!push_rom(corpus, (const char*)base + entry.name_offset, base + entry.offset, entry.size)) {
+            return false;
+        }
+    }
+
+    return true;
+
+}
+
+static bool pend(PendingList* list, const char* path, uint32_t size) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        Pending* items = realloc(list->items, capacity * sizeof(Pending));
+        if (items == NULL) {
+            return false;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    char* copy = strdup(path);
+    if (copy == NULL) {
+        return false;
+    }
+    list->items[list->count++] = (Pending){copy, size};
+    return true;
+}
+
+// Collect every regular file under dir, rejecting oversized ones by the
+// size their directory entry reports.
+static bool walk(Corpus* corpus, PendingList* list, const char* dir) {
+
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* entry;
+    while (ok && (entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        // symlinks to roms are followed, ones to directories aren't, a link
+        // back up to an ancestor would recurse until the stack ran out
+        struct stat st;
+        if (fstatat(dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            corpus->rejected++;
+            continue;
+        }
+        if (S_ISLNK(st.st_mode)) {
+            if (fstatat(dirfd(d), entry->d_name, &st, 0) != 0) {
+                corpus->rejected++;
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                continue;
+            }
+        }
+
+        size_t length = strlen(dir) + strlen(entry->d_name) + 2;
+        char* path = malloc(length);
+        if (path == NULL) {
+            ok = false;
+            break;
+        }
+        snprintf(path, length, "%s/%s", dir, entry->d_name);
+
+        if (S_ISDIR(st.st_mode)) {
+            ok = walk(corpus, list, path);
+        } else if (S_ISREG(st.st_mode)) {
+            if (st.st_size > CORPUS_MAX_ROM) {
+                corpus->rejected++;
+            } else {
+                ok = pend(list, path, (uint32_t)st.st_size);
+            }
+        }
+        free(path);
+    }
+
+    closedir(d);
+    return ok;
+
+}
+
+static int compare_pending(const void* a, const void* b) {
+    return strcmp(((const Pending*)a)->path, ((const Pending*)b)->path);
+}
+
+static bool read_all(int fd, uint8_t* out, size_t size) {
+    while (size > 0) {
+        ssize_t got = read(fd, out, size);
+        if (got <= 0) {
+            return false;
+        }
+        out += got;
+        size -= got;
+    }
+    return true;
+}
+
+// Read every pending rom into one buffer, data first and names after it, and
+// add a view for each. Sorted by path so instance numbers don't depend on
+// the order the file system hands entries out in.
+static bool ingest(Corpus* corpus, PendingList* list) {
+
+    qsort(list->items, list->count, sizeof(Pending), compare_pending);
+
+    size_t data_size = 0;
+    size_t total = 0;
+    for (int i = 0; i < list->count; i++) {
+        data_size += list->items[i].size;
+        total += list->items[i].size + strlen(list->items[i].path) + 1;
+    }
+
+    uint8_t* buffer = malloc(total ? total : 1);
+    if (buffer == NULL || !keep_backing(corpus, buffer, total, false)) {
+        free(buffer);
+        return false;
+    }
+
+    uint8_t* data = buffer;
+    char* names = (char*)buffer + data_size;
+    for (int i = 0; i < list->count; i++) {
+        Pending* pending = &list->items[i];
+        size_t length = strlen(pending->path) + 1;
+        memcpy(names, pending->path, length);
+
+        int fd = open(pending->path, O_RDONLY);
+        if (fd < 0 || !read_all(fd, data, pending->size)) {
+            corpus->rejected++;
+        } else if (!push_rom(corpus, names, data, pending->size)) {
+            close(fd);
+            return false;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        data += pending->size;
+        names += length;
+    }
+
+    return true;
+
+}
+
+bool corpus_add(Corpus* corpus, const char* path) {
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+
+    PendingList list = {0};
+    bool ok;
+
+    if (S_ISDIR(st.st_mode)) {
+        ok = walk(corpus, &list, path);
+    } else {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        CorpusHeader header;
+        if (read_header(fd, &header)) {
+            ok = add_packed(corpus, fd, st.st_size);
+            close(fd);
+            return ok;
+        }
+        close(fd);
+
+        if (st.st_size > CORPUS_MAX_ROM) {
+            corpus->rejected++;
+            return true;
+        }
+        ok = pend(&list, path, (uint32_t)st.st_size);
+    }
+
+    ok = ok && ingest(corpus, &list);
+
+    for (int i = 0; i < list.count; i++) {
+        free(list.items[i].path);
+    }
+    free(list.items);
+    return ok;
+
+}
+
+// True for the paths that hold more than one rom: directories and packed
+// corpus files.
+bool corpus_is_bundle(const char* path) {
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return true;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    CorpusHeader header;
+    bool packed = read_header(fd, &header);
+    close(fd);
+    return packed;
+
+}
+
+bool corpus_write(const Corpus* corpus, const char* path) {
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    CorpusHeader header;
+    memcpy(header.magic, CORPUS_MAGIC, sizeof(header.magic));
+    header.version = CORPUS_VERSION;
+    header.count = corpus->count;
+    header.reserved = 0;
+
+    // names right after the index, then the rom data
+    size_t names_start = sizeof(header) + corpus->count * sizeof(CorpusEntry);
+    size_t names_size = 0;
+    for (int i = 0; i < corpus->count; i++) {
+        names_size += strlen(corpus->roms[i].name) + 1;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    size_t name_offset = names_start;
+    size_t data_offset = names_start + names_size;
+    for (int i = 0; ok && i < corpus->count; i++) {
+        CorpusEntry entry = {
+            .name_offset = (uint32_t)name_offset,
+            .offset = (uint32_t)data_offset,
+            .size = corpus->roms[i].size,
+            .reserved = 0,
+        };
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+        name_offset += strlen(corpus->roms[i].name) + 1;
+        data_offset += corpus->roms[i].size;
+    }
+    for (int i = 0; ok && i < corpus->count; i++) {
+        const char* name = corpus->roms[i].name;
+        ok = fwrite(name, 1, strlen(name) + 1, file) == strlen(name) + 1;
+    }
+    for (int i = 0; ok && i < corpus->count; i++) {
+        ok = fwrite(corpus->roms[i].data, 1, corpus->roms[i].size, file) == corpus->roms[i].size;
+    }
+
+    return fclose(file) == 0 && ok;
+
+}
@@ -0,0 +1,297 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/debug.h"
+
+// the longest command line the console reads
+#define DEBUG_LINE      256
+
+Debugger* debugger_create(void) {
+    return calloc(1, sizeof(Debugger));
+}
+
+void debugger_free(Debugger* debug) {
+    free(debug);
+}
+
+// Arm or clear the breakpoint at addr, false when it already was.
+bool debug_set_breakpoint(Debugger* debug, uint16_t addr, bool on) {
+    if (debug_breakpoint(debug, addr) == on) {
+        return false;
+    }
+    debug->breakpoints[addr >> 6] ^= 1ull << (addr & 63);
+    debug->breakpoint_count += on ? 1 : -1;
+    return true;
+}
+
+// Watch len bytes from addr for writes, false when every slot is taken or
+// the range runs off the end of memory.
+bool debug_add_watchpoint(Debugger* debug, uint16_t addr, uint32_t len) {
+    if (debug->watchpoint_count == DEBUG_WATCHPOINTS || len == 0 || addr + len > MEMORY_SIZE) {
+        return false;
+    }
+    Watchpoint* watch = &debug->watchpoints[debug->watchpoint_count++];
+    watch->start = addr;
+    watch->end = (uint16_t)(addr + len - 1);
+    return true;
+}
+
+// Drop the watchpoint starting at addr, false when there's none.
+bool debug_remove_watchpoint(Debugger* debug, uint16_t addr) {
+    for (int w = 0; w < debug->watchpoint_count; w++) {
+        if (debug->watchpoints[w].start == addr) {
+            debug->watchpoints[w] = debug->watchpoints[--debug->watchpoint_count];
+            return true;
+        }
+    }
+    return false;
+}
+
+// run_instructions() for a machine with something armed: up to budget
+// instructions through emulate_cycle(), stopping before an instruction with
+// a breakpoint on it and right after one that wrote to a watched range, with
+// c8->debug->stop saying which. Timer loops are spun through for real so a
+// breakpoint inside one still fires, an FX0A wait or the display wait ends
+// the run as on any other core. Returns how many instructions ran.
+int run_debug(Chip8* c8, int budget) {
+
+    Debugger* debug = c8->debug;
+    bool resume = debug->resume && debug->stop_pc == (c8->PC & c8->memory_mask);
+    debug->stop = DEBUG_NONE;
+    debug->resume = false;
+
+    int executed = 0;
+    while (executed < budget) {
+        uint16_t pc = c8->PC & c8->memory_mask;
+        if (debug_breakpoint(debug, pc) && !(resume && executed == 0)) {
+            debug->stop = DEBUG_BREAKPOINT;
+            debug->stop_pc = pc;
+            debug->resume = true;
+            break;
+        }
+        executed++;
+        bool stop = emulate_cycle(c8);
+        if (debug->stop != DEBUG_NONE) {
+            break;
+        }
+        if (stop) {
+            if (c8->idle != IDLE_TIMER) {
+                break;
+            }
+            c8->idle = IDLE_NONE;
+        }
+    }
+    return executed;
+
+}
+
+static void print_registers(const Chip8* c8, FILE* out) {
+    uint16_t pc = c8->PC & c8->memory_mask;
+    fprintf(out, "PC: %04X (%02X%02X) I: %04X delay: %d sound: %d\nV:", pc, c8->memory[pc],
+            c8->memory[(pc + 1) & c8->memory_mask], c8->I, c8->delay_timer, c8->sound_timer);
+    for (int i = 0; i < 16; i++) {
+        fprintf(out, " %02X", c8->V[i]);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_stack(const Chip8* c8, FILE* out) {
+    // 2NNN bumps stack_idx before storing, so the live frames are
+    // stack[1..stack_idx], and an unbalanced 00EE wraps stack_idx to 255
+    fprintf(out, "stack (%d):", c8->stack_idx);
+    int depth = c8->stack_idx < 16 ? c8->stack_idx : 16;
+    for (int i = c8->stack_idx; i > c8->stack_idx - depth; i--) {
+        fprintf(out, " %04X", c8->stack[i & 0xF]);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_memory(const Chip8* c8, uint16_t addr, uint32_t len, FILE* out) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (i % 16 == 0) {
+            fprintf(out, i ? "\n%04X:" : "%04X:", (addr + i) & c8->memory_mask);
+        }
+        fprintf(out, " %02X", c8->memory[(addr + i) & c8->memory_mask]);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_points(const Debugger* debug, FILE* out) {
+    fprintf(out, "breakpoints:");
+    for (uint32_t addr = 0; addr < MEMORY_SIZE; addr++) {
+        if (debug_breakpoint(debug, (uint16_t)addr)) {
+            fprintf(out, " %04X", addr);
+        }
+    }
+    fprintf(out, "\nwatchpoints:");
+    for (int w = 0; w < debug->watchpoint_count; w++) {
+        fprintf(out, " %04X-%04X", debug->watchpoints[w].start, debug->watchpoints[w].end);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_stop(const Chip8* c8, FILE* out) {
+    const Debugger* debug = c8->debug;
+    if (debug->stop == DEBUG_BREAKPOINT) {
+        fprintf(out, "breakpoint at %04X\n", debug->stop_pc);
+    } else if (debug->stop == DEBUG_WATCHPOINT) {
+        fprintf(out, "watchpoint: %04X wrote %04X\n", debug->stop_pc, debug->stop_addr);
+    }
+    print_registers(c8, out);
+}
+
+static const char* console_help =
+    "b ADDR          break when PC gets to ADDR\n"
+    "d ADDR          delete the breakpoint at ADDR\n"
+    "w ADDR [LEN]    stop after a write to LEN bytes (1) from ADDR\n"
+    "u ADDR          delete the watchpoint starting at ADDR\n"
+    "l               list breakpoints and watchpoints\n"
+    "s [N]           step N instructions (1), breakpoints don't stop a step\n"
+    "c [FRAMES]      continue until a breakpoint, a watchpoint or FRAMES frames\n"
+    "r               registers\n"
+    "k               stack, innermost call first\n"
+    "m ADDR [LEN]    dump LEN bytes (64) of memory from ADDR\n"
+    "q               quit\n"
+    "Numbers are hex, empty line repeats the last command.\n";
+
+// Where the console is in the run: the frame it's in and how many of its
+// instructions ran, the timers tick whenever a frame's worth is done.
+typedef struct ConsoleClock {
+    uint64_t ips;
+    uint64_t frame;
+    uint64_t ran;
+} ConsoleClock;
+
+static void end_frame(Chip8* c8, ConsoleClock* clock) {
+    c8->draw_flag = 0;
+    tick_timers(c8);
+    clock->frame++;
+    clock->ran = 0;
+}
+
+// One instruction whatever breakpoints say. A timer loop only stops a run so
+// it can be skipped, stepping through one mustn't end the frame any earlier
+// than run_debug() would.
+static void step(Chip8* c8, ConsoleClock* clock) {
+    c8->debug->stop = DEBUG_NONE;
+    bool stop = emulate_cycle(c8) && c8->idle != IDLE_TIMER;
+    c8->idle = IDLE_NONE;
+    if (++clock->ran >= frame_instructions(clock->frame, clock->ips) || stop) {
+        end_frame(c8, clock);
+    }
+}
+
+// Frames at the console's ips until the debugger stops the run or frames ran.
+static void run_frames(Chip8* c8, ConsoleClock* clock, uint64_t frames) {
+    for (uint64_t done = 0; done < frames;) {
+        uint64_t budget = frame_instructions(clock->frame, clock->ips) - clock->ran;
+        int ran = run_instructions(c8, budget > INT32_MAX ? INT32_MAX : (int)budget);
+        clock->ran += ran;
+        if (c8->debug->stop != DEBUG_NONE) {
+            return;
+        }
+        // short of the budget only when the display wait quirk ended the frame
+        if (clock->ran >= frame_instructions(clock->frame, clock->ips) || (uint64_t)ran < budget) {
+            end_frame(c8, clock);
+            done++;
+        }
+    }
+}
+
+// Drive the machine from commands read from in (see console_help), the
+// machine needs c8->debug. Runs at ips instructions a second of emulated
+// time, ticking the timers once per frame, until q or the end of in.
+void debug_console(Chip8* c8, uint64_t ips, FILE* in, FILE* out) {
+
+    ConsoleClock clock = {ips, 0, 0};
+    char line[DEBUG_LINE];
+    char last[DEBUG_LINE] = "";
+
+    print_registers(c8, out);
+    for (;;) {
+        fprintf(out, "(chip8) ");
+        fflush(out);
+        if (fgets(line, sizeof(line), in) == NULL) {
+            return;
+        }
+        if (line[0] == '\n') {
+            strcpy(line, last);
+        } else {
+            strcpy(last, line);
+        }
+
+        char command = 0;
+        unsigned long a = 0;
+        unsigned long b = 0;
+        int args = sscanf(line, " %c %lx %lx", &command, &a, &b) - 1;
+        Debugger* debug = c8->debug;
+
+        switch (command) {
+            case 'b':
+            case 'd':
+                if (args < 1 || a >= MEMORY_SIZE) {
+                    fprintf(out, "%c needs an address\n", command);
+                } else if (!debug_set_breakpoint(debug, (uint16_t)a, command == 'b')) {
+                    fprintf(out, command == 'b' ? "already a breakpoint at %04lX\n" : "no breakpoint at %04lX\n", a);
+                }
+                break;
+            case 'w':
+                if (args < 1 || !debug_add_watchpoint(debug, (uint16_t)a, args > 1 ? (uint32_t)b : 1)) {
+                    fprintf(out, "w needs an address and a length inside memory, and at most %d watchpoints\n", DEBUG_WATCHPOINTS);
+                }
+                break;
+            case 'u':
+                if (args < 1 || !debug_remove_watchpoint(debug, (uint16_t)a)) {
+                    fprintf(out, "no watchpoint starting at %04lX\n", a);
+                }
+                break;
+            case 'l':
+                print_points(debug, out);
+                break;
+            case 's':
+                for (unsigned long i = 0; i < (args > 0 ? a : 1); i++) {
+                    step(c8, &clock);
+                    if (debug->stop == DEBUG_WATCHPOINT) {
+                        break;
+                    }
+                }
+                debug->resume = false;
+                print_stop(c8, out);
+                break;
+            case 'c':
+                if (args < 1 && !debug_armed(debug)) {
+                    fprintf(out, "nothing would stop it, arm something or pass c FRAMES\n");
+                    break;
+                }
+                run_frames(c8, &clock, args > 0 ? a : UINT64_MAX);
+                print_stop(c8, out);
+                if (debug->stop == DEBUG_NONE) {
+                    fprintf(out, "frame %llu\n", (unsigned long long)clock.frame);
+                }
+                break;
+            case 'r':
+                print_registers(c8, out);
+                break;
+            case 'k':
+                print_stack(c8, out);
+                break;
+            case 'm':
+                if (args < 1) {
+                    fprintf(out, "m needs an address\n");
+                } else {
+                    print_memory(c8, (uint16_t)a, args > 1 ? (uint32_t)b : 64, out);
+                }
+                break;
+            case 'q':
+                return;
+            default:
+                fprintf(out, "%s", console_help);
+                break;
+        }
+    }
+
+}
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/chip8.h"
+#include "include/env.h"
+
+// Environment interface over a pool of machines, see include/env.h.
+
+// machines a slab holds, 64 of them come to a little over 400KB, plus 4MB
+// of memory for XO-CHIP ones
+#define ENV_SLAB 64
+
+typedef struct EnvSlab {
+    struct EnvSlab* next;
+    uint8_t* big_memory;        // XO-CHIP's 64KB per machine, NULL for the others
+    Chip8 machines[ENV_SLAB];
+} EnvSlab;
+
+static void free_slab(EnvSlab* slab) {
+    free(slab->big_memory);
+    free(slab);
+}
+
+// Add a slab's worth of free machines, the first of them on top.
+static bool grow(Env* env) {
+
+    EnvSlab* slab = calloc(1, sizeof(EnvSlab));
+    if (slab == NULL) {
+        return false;
+    }
+    if (env->variant == VARIANT_XOCHIP) {
+        slab->big_memory = malloc((size_t)ENV_SLAB * MEMORY_SIZE);
+        if (slab->big_memory == NULL) {
+            free_slab(slab);
+            return false;
+        }
+    }
+    Chip8** stack = realloc(env->free, (env->capacity + ENV_SLAB) * sizeof(Chip8*));
+    if (stack == NULL) {
+        free_slab(slab);
+        return false;
+    }
+
+    env->free = stack;
+    for (int i = ENV_SLAB - 1; i >= 0; i--) {
+        if (slab->big_memory) {
+            slab->machines[i].big_memory = slab->big_memory + (size_t)i * MEMORY_SIZE;
+        }
+        env->free[env->free_count++] = &slab->machines[i];
+    }
+    slab->next = env->slabs;
+    env->slabs = slab;
+    env->capacity += ENV_SLAB;
+    return true;
+
+}
+
+static Chip8* take(Env* env) {
+    if (env->free_count == 0 && !grow(env)) {
+        return NULL;
+    }
+    return env->free[--env->free_count];
+}
+
+// An environment for the rom (which isn't copied) with room for `capacity`
+// states before the pool has to grow. NULL when the rom doesn't fit the
+// variant's memory or the pool can't be allocated.
+Env* env_create(const uint8_t* rom, size_t rom_size, Chip8Variant variant, size_t capacity) {
+
+    size_t memory = variant == VARIANT_XOCHIP ? MEMORY_SIZE : CHIP8_MEMORY;
+    if (rom_size > memory - 0x200) {
+        return NULL;
+    }
+
+    Env* env = calloc(1, sizeof(Env));
+    if (env == NULL) {
+        return NULL;
+    }
+    env->rom = rom;
+    env->rom_size = rom_size;
+    env->variant = variant;
+    env->quirks = variant_quirks(variant);
+    env->instructions_per_frame = HEADLESS_INSTRUCTIONS;
+
+    do {
+        if (!grow(env)) {
+            env_destroy(env);
+            return NULL;
+        }
+    } while (env->capacity < capacity);
+
+    return env;
+
+}
+
+// Frees every state too, released or not.
+void env_destroy(Env* env) {
+    if (env == NULL) {
+        return;
+    }
+    while (env->slabs) {
+        EnvSlab* next = env->slabs->next;
+        free_slab(env->slabs);
+        env->slabs = next;
+    }
+    free(env->free);
+    free(env);
+}
+
+// A fresh state with the rom loaded, CXNN seeded from seed. NULL only when
+// the pool is empty and can't grow.
+Chip8* env_reset(Env* env, uint64_t seed) {
+
+    Chip8* c8 = take(env);
+    if (c8 == NULL) {
+        return NULL;
+    }
+    c8->variant = env->variant;
+    c8->quirks = env->quirks;
+    c8->seed = seed;
+    init_cpu(c8);
+    load_rom_data(c8, env->rom, env->rom_size);
+    return c8;
+
+}
+
+// Hold keys down for `frames` frames, each one running the env's
+// instructions per frame and ticking the timers once. reward (when not
+// NULL) gets the sum of the reward hook over the frames. Returns the state's
+// own framebuffer, see chip8_framebuffer(), valid until it's stepped again.
+const uint64_t* env_step(Env* env, Chip8* c8, uint16_t keys, int frames, double* reward) {
+
+    double total = 0;
+    chip8_set_keys(c8, keys);
+    for (int frame = 0; frame < frames; frame++) {
+        run_instructions(c8, env->instructions_per_frame);
+        c8->draw_flag = 0;
+        tick_timers(c8);
+        if (env->reward) {
+            total += env->reward(c8, env->user);
+        }
+    }
+    if (reward) {
+        *reward = total;
+    }
+    return chip8_framebuffer(c8);
+
+}
+
+// A new state exactly where c8 is, stepping either one leaves the other
+// alone. NULL only when the pool is empty and can't grow.
+Chip8* env_clone(Env* env, const Chip8* c8) {
+    Chip8* clone = take(env);
+    if (clone) {
+        // pooled machines come with their variant's memory, this can't fail
+        chip8_copy(clone, c8);
+    }
+    return clone;
+}
+
+// Hand a state from env_reset() or env_clone() back to the pool.
+void env_release(Env* env, Chip8* c8) {
+    if (c8) {
+        env->free[env->free_count++] = c8;
+    }
+}
@@ -0,0 +1,316 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "include/chip8.h"
+#include "include/fleet.h"
+#include "include/corpus.h"
+#include "include/batch.h"
+
+// Work-stealing pool for fleet runs.
+//
+// Every instance is an independent task, so instead of a queue of task
+// objects each worker owns a contiguous range of instance indices packed
+// into one 64-bit atomic: the low 32 bits are the next index to run and the
+// high 32 bits are one past the last. The owner pops from the front, idle
+// workers steal from the back of someone else's range, and since both ends
+// live in the same word a single compare-and-swap settles any race on the
+// last task. Nothing is ever pushed after the start, so that's all a deque
+// needs to do here.
+//
+// A batched fleet's tasks are lockstep batches instead, up to BATCH_LANES
+// instances of the same rom each: task t runs rom t % count, instances
+// (t / count * BATCH_LANES + k) * count + t % count for every lane k.
+
+typedef struct FleetWorker {
+    _Atomic uint64_t range;
+    pthread_t thread;
+    int id;
+    struct Fleet* fleet;
+} FleetWorker;
+
+typedef struct Fleet {
+    const Corpus* corpus;
+    Chip8Core core;
+    int variant;            // negative to pick per rom, see run_fleet()
+    int quirks;             // negative for the variant's profile
+    bool batch;             // tasks are Batch runs, see the top of the file
+    int instances;
+    uint64_t max_instructions;
+    uint64_t max_frames;
+    uint64_t seed;
+    FleetResult* results;
+    FleetWorker* workers;
+    int worker_count;
+} Fleet;
+
+#define RANGE(begin, end)   (((uint64_t)(end) << 32) | (uint32_t)(begin))
+#define RANGE_BEGIN(range)  ((uint32_t)(range))
+#define RANGE_END(range)    ((uint32_t)((range) >> 32))
+
+static bool pop_front(FleetWorker* worker, uint32_t* task) {
+    uint64_t range = atomic_load(&worker->range);
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+        uint64_t next = RANGE(RANGE_BEGIN(range) + 1, RANGE_END(range));
+        if (atomic_compare_exchange_weak(&worker->range, &range, next)) {
+            *task = RANGE_BEGIN(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool steal_back(FleetWorker* victim, uint32_t* task) {
+    uint64_t range = atomic_load(&victim->range);
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+        uint64_t next = RANGE(RANGE_BEGIN(range), RANGE_END(range) - 1);
+        if (atomic_compare_exchange_weak(&victim->range, &range, next)) {
+            *task = RANGE_END(range) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Scan the other workers starting from our neighbour so thieves don't all
+// pile onto worker 0, give up once a whole lap finds nothing left.
+static bool steal(Fleet* fleet, int thief, uint32_t* task) {
+    for (int i = 1; i < fleet->worker_count; i++) {
+        FleetWorker* victim = &fleet->workers[(thief + i) % fleet->worker_count];
+        if (steal_back(victim, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reset c8 into the given instance, false when its rom didn't load.
+static bool prepare_instance(Fleet* fleet, Chip8* c8, uint32_t instance) {
+    FleetResult* result = &fleet->results[instance];
+
+    // every instance gets its own stream of random numbers, the same one
+    // every time the fleet runs with this seed
+    const CorpusRom* rom = &fleet->corpus->roms[instance % fleet->corpus->count];
+    c8->seed = fleet->seed + instance * 0x9E3779B97F4A7C15ull;
+    if (!chip8_set_variant(c8, fleet->variant < 0 ? variant_for_rom(rom->name) : (Chip8Variant)fleet->variant)) {
+        result->status = ENOMEM;
+        return false;
+    }
+    if (fleet->quirks >= 0) {
+        chip8_set_quirks(c8, (Chip8Quirks)fleet->quirks);
+    }
+    result->status = load_rom_data(c8, rom->data, rom->size);
+    return result->status == 0;
+}
+
+static void run_instance(Fleet* fleet, Chip8* c8, uint32_t instance) {
+    if (!prepare_instance(fleet, c8, instance)) {
+        return;
+    }
+    FleetResult* result = &fleet->results[instance];
+    result->instructions = run_headless(c8, fleet->max_instructions, fleet->max_frames, &result->frames);
+    result->display_hash = chip8_display_hash(c8);
+}
+
+static void run_batch(Fleet* fleet, Batch* batch, Chip8** machines, uint32_t task) {
+    uint32_t count = fleet->corpus->count;
+    uint32_t rom = task % count;
+    uint64_t row = (uint64_t)(task / count) * BATCH_LANES;
+
+    uint32_t instance[BATCH_LANES];
+    batch->lanes = 0;
+    for (int k = 0; k < BATCH_LANES; k++) {
+        uint64_t i = (row + k) * count + rom;
+        if (i >= (uint64_t)fleet->instances) {
+            break;
+        }
+        Chip8* c8 = machines[batch->lanes];
+        if (prepare_instance(fleet, c8, (uint32_t)i)) {
+            batch->lane[batch->lanes] = c8;
+            instance[batch->lanes++] = (uint32_t)i;
+        }
+    }
+
+    batch_run(batch, fleet->max_instructions, fleet->max_frames);
+
+    for (int l = 0; l < batch->lanes; l++) {
+        FleetResult* result = &fleet->results[instance[l]];
+        result->instructions = batch->instructions[l];
+        result->frames = batch->frames[l];
+        result->display_hash = chip8_display_hash(batch->lane[l]);
+    }
+}
+
+// A batched worker's lanes, a machine each, all created at once.
+static Chip8** create_lanes(void) {
+    Chip8** machines = calloc(BATCH_LANES, sizeof(Chip8*));
+    if (machines == NULL) {
+        return NULL;
+    }
+    for (int l = 0; l < BATCH_LANES; l++) {
+        machines[l] = chip8_create(CORE_SWITCH, 0);
+        if (machines[l] == NULL) {
+            while (l--) {
+                chip8_destroy(machines[l]);
+            }
+            free(machines);
+            return NULL;
+        }
+    }
+    return machines;
+}
+
+static void* worker_main(void* arg) {
+    FleetWorker* worker = arg;
+    Fleet* fleet = worker->fleet;
+
+    uint32_t task;
+    if (fleet->batch) {
+        // the lanes step through emulate_cycle(), so fleet->core doesn't matter
+        Batch* batch = calloc(1, sizeof(Batch));
+        Chip8** machines = create_lanes();
+        if (batch && machines) {
+            while (pop_front(worker, &task) || steal(fleet, worker->id, &task)) {
+                run_batch(fleet, batch, machines, task);
+            }
+        }
+        for (int l = 0; machines && l < BATCH_LANES; l++) {
+            chip8_destroy(machines[l]);
+        }
+        free(machines);
+        free(batch);
+        return NULL;
+    }
+
+    // One machine per worker, reset for every task, so a task costs no allocation.
+    Chip8* c8 = chip8_create(fleet->core, 0);
+    if (c8 == NULL) {
+        return NULL;
+    }
+
+    while (pop_front(worker, &task) || steal(fleet, worker->id, &task)) {
+        run_instance(fleet, c8, task);
+    }
+
+    chip8_destroy(c8);
+    return NULL;
+}
+
+int run_fleet(const Corpus* corpus, int instances, int threads, Chip8Core core, int variant, int quirks,
+              bool batch, uint64_t max_instructions, uint64_t max_frames, uint64_t seed) {
+
+    uint32_t tasks = instances;
+    if (batch) {
+        uint32_t rows = (instances + corpus->count - 1) / corpus->count;
+        tasks = (rows + BATCH_LANES - 1) / BATCH_LANES * corpus->count;
+    }
+
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+    if ((uint32_t)threads > tasks) {
+        threads = tasks;
+    }
+
+    Fleet fleet = {
+        .corpus = corpus,
+        .core = core,
+        .variant = variant,
+        .quirks = quirks,
+        .batch = batch,
+        .instances = instances,
+        .max_instructions = max_instructions,
+        .max_frames = max_frames,
+        .seed = seed,
+        .results = calloc(instances, sizeof(FleetResult)),
+        .workers = calloc(threads, sizeof(FleetWorker)),
+        .worker_count = threads,
+    };
+
+    if (fleet.results == NULL || fleet.workers == NULL) {
+        error("[FAILED] Could not allocate fleet of %d instances\n", instances);
+        free(fleet.results);
+        free(fleet.workers);
+        return 1;
+    }
+
+    // prepare_instance() overwrites this, so whatever no worker got to
+    // reports as failed rather than as a run of nothing
+    for (int i = 0; i < instances; i++) {
+        fleet.results[i].status = FLEET_NOT_RUN;
+    }
+
+    if (batch) {
+        printf("[PENDING] Running %d instances in %u batches of up to %d on %d threads\n",
+               instances, tasks, BATCH_LANES, threads);
+    } else {
+        printf("[PENDING] Running %d instances on %d threads\n", instances, threads);
+    }
+
+    // Hand out even slices up front, stealing evens out whatever imbalance
+    // the roms themselves create.
+    for (int i = 0; i < threads; i++) {
+        uint32_t begin = (uint64_t)tasks * i / threads;
+        uint32_t end = (uint64_t)tasks * (i + 1) / threads;
+        atomic_init(&fleet.workers[i].range, RANGE(begin, end));
+        fleet.workers[i].id = i;
+        fleet.workers[i].fleet = &fleet;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&fleet.workers[started].thread, NULL, worker_main, &fleet.workers[started])) {
+            break;
+        }
+    }
+    if (started == 0) {
+        // Couldn't get any threads, just do the work here.
+        worker_main(&fleet.workers[0]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(fleet.workers[i].thread, NULL);
+    }
+
+    double elapsed = seconds_since(&start);
+
+    int failed = 0;
+    uint64_t total_instructions = 0;
+    for (int i = 0; i < instances; i++) {
+        FleetResult* result = &fleet.results[i];
+        if (result->status == FLEET_NOT_RUN) {
+            error("[FAILED] instance %d: %s never ran, no machine to run it on\n", i, corpus->roms[i % corpus->count].name);
+            failed++;
+            continue;
+        }
+        if (result->status) {
+            error("[FAILED] instance %d: could not load %s\n", i, corpus->roms[i % corpus->count].name);
+            failed++;
+            continue;
+        }
+        printf("%d %s instructions: %llu frames: %llu display: %08X\n", i, corpus->roms[i % corpus->count].name,
+               (unsigned long long)result->instructions, (unsigned long long)result->frames,
+               result->display_hash);
+        total_instructions += result->instructions;
+    }
+
+    printf("instances: %d threads: %d failed: %d\n", instances, threads, failed);
+    printf("instructions: %llu\n", (unsigned long long)total_instructions);
+    printf("elapsed: %.6fs\n", elapsed);
+    printf("instructions per second: %.0f\n", elapsed > 0 ? total_instructions / elapsed : 0.0);
+
+    free(fleet.results);
+    free(fleet.workers);
+
+    return failed ? 1 : 0;
+
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/governor.h"
+
+void governor_init(Governor* governor, uint64_t freq, uint64_t now) {
+    memset(governor, 0, sizeof(Governor));
+    governor->freq = freq;
+    governor->period_start = now;
+}
+
+// Close the period once a second of it has gone by: step the level and
+// report the host falling behind. Cheap enough to call every pass.
+void governor_update(Governor* governor, uint64_t now) {
+
+    uint64_t elapsed = now - governor->period_start;
+    if (elapsed < governor->freq) {
+        return;
+    }
+
+    uint64_t load = governor->busy * 1000 / elapsed;
+    bool behind = governor->late || governor->dropped;
+
+    if ((behind || load > GOVERNOR_HIGH) && governor->level < GOVERNOR_LEVELS - 1) {
+        governor->level++;
+    } else if (!behind && load < GOVERNOR_LOW && governor->level > 0) {
+        governor->level--;
+    }
+
+    bool slow = behind && governor->level == GOVERNOR_LEVELS - 1;
+    if (slow) {
+        governor->slow_periods++;
+        if (!governor->slow) {
+            error("[SLOW] The host can't keep up: %llu of %llu frames late, %llu dropped, busy %llu.%llu%% of the time\n",
+                  (unsigned long long)governor->late, (unsigned long long)governor->frames,
+                  (unsigned long long)governor->dropped, (unsigned long long)load / 10, (unsigned long long)load % 10);
+        }
+    } else if (governor->slow) {
+        error("[OK] Keeping up again\n");
+    }
+    governor->slow = slow;
+    governor_restart(governor, now);
+
+}
+
+// Add the current period to the run's totals and start a new one at now,
+// leaving the level alone. Turbo frames aren't measured, so the loop calls
+// this whenever speed changes to keep a period from spanning turbo.
+void governor_restart(Governor* governor, uint64_t now) {
+    governor->total_frames += governor->frames;
+    governor->total_late += governor->late;
+    governor->total_dropped += governor->dropped;
+    governor->total_busy += governor->busy;
+    governor->period_start = now;
+    governor->busy = 0;
+    governor->frames = 0;
+    governor->late = 0;
+    governor->dropped = 0;
+}
+
+// What the whole run came to: instructions a frame against what the frames
+// were owed, the average time a frame took to run, frames late and dropped.
+void governor_report(const Governor* governor, FILE* out) {
+
+    uint64_t frames = governor->total_frames + governor->frames;
+    if (frames == 0) {
+        return;
+    }
+    uint64_t busy = governor->total_busy + governor->busy;
+    fprintf(out, "[OK] %llu frames at %.1f instructions a frame (%.1f owed), %.1fus a frame, "
+                 "%llu late, %llu dropped, %llu seconds too slow to keep up\n",
+            (unsigned long long)frames, (double)governor->instructions / frames, (double)governor->owed / frames,
+            (double)busy * 1e6 / governor->freq / frames,
+            (unsigned long long)(governor->total_late + governor->late),
+            (unsigned long long)(governor->total_dropped + governor->dropped),
+            (unsigned long long)governor->slow_periods);
+
+}
@@ -0,0 +1,52 @@
+#ifndef AUDIO_H_
+#define AUDIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Beeper output for the window.
+//
+// The emulation loop calls audio_frame() once per 60Hz frame with whether
+// the sound timer is running, and for XO-CHIP roms the audio pattern and
+// pitch they set. Only changes get pushed, as AudioEdges stamped
+// with the frame they happened on, into an SPSC ring (see ring.h). SDL's
+// audio callback pops them and plays a square wave from a table worked out
+// when the device opens (or the pattern's 128 bits, looped at the pitch's
+// rate), running AUDIO_LATENCY_FRAMES behind the emulated
+// time so an edge lands where it belongs inside the callback's buffer.
+//
+// Neither side ever waits on the other. A full ring makes audio_frame() try
+// the same edge again next frame, and the callback puts its clock back on
+// the emulated one when the emulator stalls or gets too far ahead.
+
+#define AUDIO_RATE              48000
+#define AUDIO_BUFFER_SAMPLES    512
+#define AUDIO_TONE_HZ           440
+#define AUDIO_VOLUME            3000
+#define AUDIO_LATENCY_FRAMES    2
+#define AUDIO_RING_EDGES        256     // power of two
+
+// XO-CHIP plays its pattern at 4000Hz, an octave up or down every 48 steps
+// of pitch away from 64
+#define AUDIO_PATTERN_HZ        4000
+#define AUDIO_PATTERN_BITS      128
+
+typedef struct AudioEdge {
+    uint64_t frame;
+    bool on;
+    bool has_pattern;           // play pattern instead of the square wave
+    uint8_t pattern[AUDIO_PATTERN_BITS / 8];
+    uint32_t step;              // pattern bits per output sample, 16.16 fixed point
+} AudioEdge;
+
+typedef struct Audio Audio;
+
+// NULL when there is no audio device, the window then just runs silent.
+Audio* audio_open(void);
+void audio_close(Audio* audio);
+
+// Emulator side, never blocks and does nothing unless something changed.
+// pattern is NULL for the plain beep.
+void audio_frame(Audio* audio, uint64_t frame, bool on, const uint8_t* pattern, uint8_t pitch);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Lockstep batches: BATCH_LANES machines running side by side, for runs of
+// the same rom with different seeds and inputs where most machines sit at
+// the same PC most of the time.
+//
+// The registers live here in structure-of-arrays form, V[x] of every lane
+// next to each other and so on, instead of in each Chip8. Every step takes
+// the lowest PC any lane with instructions left is at, and the lanes at that
+// PC holding the same opcode run it together: the common instructions (the
+// ALU, skips, jumps, I and the timers) as one loop over all the lanes under
+// a mask, written so the compiler turns it into a handful of vector
+// instructions. Everything else (draws, memory, the stack, the extended
+// opcodes) runs lane by lane through emulate_cycle() on the lane's own
+// machine, which still holds memory, the display, the stack and the keypad.
+//
+// Each lane runs exactly what run_headless() would run on its machine, one
+// HEADLESS_INSTRUCTIONS frame at a time with the same display wait and idle
+// skipping, so a batch ends in the same state as running the machines one
+// after the other, just with most of the decoding and dispatch shared.
+
+#define BATCH_LANES 32
+
+typedef struct Batch {
+
+    // lane l's registers are V[x][l], I[l] and so on, the machines only
+    // get them back when they need them and at the end of batch_run()
+    _Alignas(32) uint8_t V[16][BATCH_LANES];
+    _Alignas(32) uint16_t I[BATCH_LANES];
+    _Alignas(32) uint16_t PC[BATCH_LANES];
+    _Alignas(32) uint8_t delay_timer[BATCH_LANES];
+    _Alignas(32) uint8_t sound_timer[BATCH_LANES];
+    _Alignas(32) uint16_t keys[BATCH_LANES];    // the keypad, a bit per key
+
+    // instructions lane l still gets this frame and ran so far, a lane
+    // with nothing left sits out every step
+    _Alignas(32) uint8_t left[BATCH_LANES];
+    _Alignas(32) uint8_t ran[BATCH_LANES];
+
+    // the machines, set by the host, lanes past `lanes` are unused. Every
+    // lane has to run the same variant and quirk profile.
+    Chip8* lane[BATCH_LANES];
+    int lanes;
+
+    // every lane's memory was the same at the start of the run, and the 64
+    // byte pages (see DIRTY_PAGE()) any lane wrote since
+    bool shared_code;
+    uint64_t written;
+
+    // bit per lane that ended this frame in an idle loop
+    uint32_t idle;
+
+    // what batch_run() ran on each lane
+    uint64_t instructions[BATCH_LANES];
+    uint64_t frames[BATCH_LANES];
+
+} Batch;
+
+void batch_run(Batch* batch, uint64_t max_instructions, uint64_t max_frames);
+
+#endif
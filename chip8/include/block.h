@@ -0,0 +1,73 @@
+#ifndef BLOCK_H_
+#define BLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+#include "decode.h"
+
+// Basic-block translation cache for CORE_BLOCK.
+//
+// A block is a straight run of instructions starting at some PC, ending at
+// the first instruction that can send PC anywhere other than the next
+// instruction (jumps, calls, returns, skips), that stores to memory, draws or
+// waits. Inside a block runs of 6XNN/7XNN on the same register fold into a
+// single op, and a skip followed by a 1NNN becomes one conditional branch.
+//
+// Stores only mark 64 byte pages in c8->dirty_pages (see mem_written() and
+// DIRTY_PAGE()), the core throws away the blocks touching those pages before
+// it looks up the next one, stores to pages no block came from (the usual case, roms keep
+// their variables apart from their code) cost nothing more than that mark.
+// Since stores always end a block, a rom rewriting the block it's
+// running from is caught as well.
+
+#define BLOCK_PAGE_SHIFT        6
+#define BLOCK_MAX_INSTRUCTIONS  32      // 64 bytes, so a block spans at most two pages
+#define BLOCK_POOL              1024    // translated blocks kept before starting over
+
+// Kinds a BlockOp can have on top of the OpHandlers it shares with decode.h
+enum {
+    BOP_SET = OP_COUNT,     // a folded 6XNN/7XNN run that starts with a 6XNN: VX = NN
+    BOP_ADD,                // a folded run of 7XNNs: VX += NN
+    BOP_BRANCH,             // skip `cond` then 1NNN: PC = skipped ? PC + 4 : NNN
+};
+
+typedef struct BlockOp {
+    uint8_t kind;           // OpHandler or BOP_*
+    uint8_t cond;           // BOP_BRANCH's skip instruction, as an OpHandler
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint8_t len;            // how many original instructions this op stands for
+    uint16_t nnn;
+    uint16_t op;            // raw opcode, for op_unknown()
+} BlockOp;
+
+typedef struct Block {
+    uint64_t pages;         // DIRTY_PAGE() bit per 64 byte page the block was translated from
+    uint8_t op_count;
+    BlockOp ops[BLOCK_MAX_INSTRUCTIONS];
+} Block;
+
+typedef struct BlockCache {
+    uint16_t slot[MEMORY_SIZE];     // PC -> 1 + index into pool, 0 when not translated
+    uint16_t used;
+    uint64_t code_pages;            // every page some live block was translated from
+
+    // where the last run's budget ran out partway through a block: picking
+    // up at resume_op of that block when PC is still resume_pc beats
+    // translating a new block from the middle of it every frame
+    bool resume;
+    uint16_t resume_pc;
+    uint16_t resume_block;          // index into pool
+    uint8_t resume_op;
+
+    Block pool[BLOCK_POOL];
+} BlockCache;
+
+void block_cache_flush(BlockCache* cache, uint32_t addresses);
+int run_block(Chip8* c8, int budget);
+
+#endif
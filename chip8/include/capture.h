@@ -0,0 +1,59 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "ring.h"
+
+// Video capture of a machine's display as an animated GIF.
+//
+// A machine with a Capture attached (c8->capture) hands it its display from
+// tick_timers(), once per frame. Only frames that differ from the last one
+// handed over go into an SPSC ring, a run of identical frames just becomes
+// a longer delay, and frames skip_idle_frames() jumps over only move the
+// frame count on. A background thread encodes them, so the emulator never
+// formats a pixel or waits on the disk, and only blocks if the encoder
+// falls a whole ring behind, a capture is never missing frames.
+//
+// The GIF is lossless, 4 colours (the window's palette), looping, at
+// `scale` screen pixels per high resolution pixel (twice that for low
+// resolution ones). Plain CHIP-8 machines get a 64x32 canvas, the others
+// 128x64. Each frame after the first only covers the band of rows that
+// changed and is drawn over the previous one, timed in the GIF's 1/100s
+// steps from the 60Hz frame count so the whole thing never drifts.
+
+#define CAPTURE_RING_FRAMES     1024    // power of two
+
+typedef struct CaptureFrame {
+    uint64_t frame;
+    uint64_t display[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+    bool hires;
+} CaptureFrame;
+
+typedef struct Capture {
+    RingWriter writer;
+    FILE* file;
+
+    // the emulator thread's: frames handed over so far and the last frame
+    // pushed, to collapse repeats
+    uint64_t frame;
+    CaptureFrame last;
+    bool has_last;
+
+    // the writer's, set up by capture_open()
+    int width;
+    int height;
+    int scale;
+    struct CaptureWriter* state;
+} Capture;
+
+Capture* capture_open(const char* path, const Chip8* c8, int scale);
+void capture_frame(Capture* capture, const Chip8* c8);
+bool capture_close(Capture* capture);
+
+#endif
@@ -1,15 +1,272 @@
 #ifndef CHIP8_H_
 #define CHIP8_H_
 
-void init_cpu(void);
-int load_rom(char* filename);
-bool emulate_cycle(void);
-
-void init_sdl_display();
-void draw(unsigned char* display);
-void sdl_handler(unsigned char* keypad);
-void stop_display();
-void print_arrays(unsigned char* given_array, int array_size);
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+// The CHIP-8 machine, built as the chip8_core library (no SDL in here) that
+// mygame, chip8_bench and anything else embedding the interpreter link
+// against. The usual lifecycle is:
+//
+//     Chip8* c8 = chip8_create(CORE_BLOCK, seed);
+//     chip8_set_variant(c8, VARIANT_SCHIP);     // only for SUPER-CHIP/XO-CHIP roms
+//     chip8_set_quirks(c8, QUIRKS_CHIP48);      // only if the variant's usual profile is wrong
+//     load_rom(c8, path);                       // or load_rom_data()
+//     every 60Hz frame:
+//         chip8_set_keys(c8, keys);
+//         run_instructions(c8, instructions_per_frame);   // c8->idle says if it's waiting
+//         tick_timers(c8);
+//         draw chip8_framebuffer(c8) if c8->dirty_rows says it changed
+//     init_cpu(c8) to reset, chip8_destroy(c8) when done
+//
+// Everything else below is there for hosts that need more control (the
+// fleet runner, the cores themselves, savestates).
+
+// Define screen dimensions, the low resolution every variant starts in and
+// the SUPER-CHIP/XO-CHIP high resolution mode
+#define SCREEN_WIDTH    64
+#define SCREEN_HEIGHT   32
+#define HIRES_WIDTH     128
+#define HIRES_HEIGHT    64
+
+// XO-CHIP draws on two bitplanes, a pixel's colour is the planes it's lit on
+#define DISPLAY_PLANES  2
+#define ROW_WORDS       (HIRES_WIDTH / 64)
+
+// XO-CHIP addresses 64KB, the others 4KB. Every machine carries the 4KB
+// inline, an XO-CHIP one gets its 64KB allocated on top (see memory)
+#define MEMORY_SIZE     65536
+#define CHIP8_MEMORY    4096
+
+// SUPER-CHIP's 8x10 digits, right after the 4x5 ones at 0
+#define BIG_FONT_ADDR   0x50
+
+// Which flavour of CHIP-8 a machine implements. Anything a variant doesn't
+// have decodes as an unknown opcode, the same as it always did.
+typedef enum Chip8Variant {
+    VARIANT_CHIP8,      // 64x32, 4KB
+    VARIANT_SCHIP,      // SUPER-CHIP 1.1: 128x64 mode, scrolling, 16x16 sprites, big font, RPL flags
+    VARIANT_XOCHIP,     // XO-CHIP: SUPER-CHIP plus 64KB, two bitplanes, F000 NNNN, audio patterns
+} Chip8Variant;
+
+// Which platform's take on the instructions they disagree on a machine
+// follows, see the QUIRK_ macros in include/ops.h for exactly what changes.
+// Every core is compiled once per profile so picking one costs nothing per
+// instruction. Setting a variant picks its usual profile.
+typedef enum Chip8Quirks {
+    QUIRKS_VIP,         // COSMAC VIP CHIP-8: VF reset, shifts read VY, FX55/FX65 move I past VX, display wait
+    QUIRKS_CHIP48,      // HP48 CHIP-48: shifts in place, FX55/FX65 move I to VX, BXNN jumps + VX
+    QUIRKS_SCHIP,       // SUPER-CHIP 1.1: CHIP-48 but FX55/FX65 leave I alone
+    QUIRKS_XOCHIP,      // XO-CHIP: the VIP's shifts, I and BNNN, no VF reset or display wait, sprites wrap
+    QUIRKS_COUNT,
+} Chip8Quirks;
+
+// What a machine was caught spinning on by run_instructions(), which then
+// skips the rest of the run instead of spinning through it, see
+// idle_on_timer() and idle_on_key() in include/ops.h.
+typedef enum Chip8Idle {
+    IDLE_NONE,
+    IDLE_TIMER,         // an FX07 loop, nothing changes until tick_timers()
+    IDLE_KEY,           // FX0A, nothing changes until chip8_set_keys() changes the keypad
+} Chip8Idle;
+
+// The interpreter cores a machine can run on, see run_instructions().
+typedef enum Chip8Core {
+    CORE_SWITCH,        // emulate_cycle(), decodes every instruction as it runs it
+    CORE_PREDECODED,    // decodes each address once, runs threaded code over the table
+    CORE_BLOCK,         // translates straight-line runs into fused blocks, see block.h
+} Chip8Core;
+
+// Memory implementation: 
+// Total space is 4kb or 4096bytes (64kb for XO-CHIP);
+//
+// Then 0x000 - 0x1FF is space for the interpreter in most chip8 roms;
+// 0x200 - 0xFFF is the program and data space
+//
+// Keep in mind that opcodes are big-endian while macs use little-endian 
+//
+// The following structures are being implemented as described in the specs
+// section of Tobias Langhoff's CHIP-8 Guide.
+//
+// Everything a machine needs lives in this struct so one process can host as
+// many machines as it wants, every function that touches the machine takes a
+// pointer to the instance it should work on.
+typedef struct Chip8 {
+
+    // Memory for the 4KB variants, reached through c8->memory like XO-CHIP's
+    uint8_t base_memory[CHIP8_MEMORY];
+
+    // Registers, CHIP-8 used 16 general purpose 8-bit registers, referred to 
+    // as VX where X is a hexadecimal digit, so V0-VF but ours will be stored in 
+    // an array and can be indexed after, use unsigned chars since they're 8-bits
+    uint8_t V[16];
+
+    // Special 16-bit register 'I' that is the index register which points at
+    // locations in memory, use short since that is 16-bits
+    uint16_t I;
+
+    // The program counter 'PC' which points at the current instruction that is in memory
+    // reminder that in memory that program space starts at 0x200
+    uint16_t PC;
+
+    // The stack, an array of 16-bit addresses, most original interpreters apparently
+    // had very limited space, with some limiting it to 2 addresses even, here I'll
+    // take a very excessive implementation of eight 16-bit addresses.
+    uint16_t stack[16];
+
+    // points to the top of the stack so to speak.
+    uint8_t stack_idx;
+
+    // the keypad:
+    uint8_t keypad[16];
+
+    // the display, per bitplane one row of ROW_WORDS 64-bit words per line
+    // with the leftmost pixel in the top bit of the first word. In low
+    // resolution only the first SCREEN_HEIGHT rows and the first word of
+    // each are used, see display_pixel()
+    uint64_t display[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+    bool hires;
+    uint8_t planes;         // bitplanes DXYN, 00E0 and the scrolls work on, XO-CHIP's FN01
+
+    // addresses wrap at the variant's memory size, 0xFFF or 0xFFFF
+    uint16_t memory_mask;
+
+    // delay timer
+    uint8_t delay_timer;
+
+    // sound timer
+    uint8_t sound_timer;
+
+    // additional flag defined to make updating display simpler
+    // display flag
+    uint8_t draw_flag;
+    uint8_t sound_flag;
+
+    // XO-CHIP's audio: the 1-bit sample pattern F002 loads and FX3A's pitch
+    uint8_t pattern[16];
+    bool has_pattern;
+    uint8_t pitch;
+
+    // SUPER-CHIP's RPL user flags, FX75/FX85
+    uint8_t rpl[16];
+
+    // bit per display row changed since the renderer last picked it up
+    uint64_t dirty_rows;
+
+    // FX0A state, the key that was seen going down while waiting for a release
+    bool key_found;
+    uint8_t key_pressed;
+
+    // CXNN's random generator (PCG32 state), see chip8_random()
+    uint64_t rng;
+
+    // Chip8Idle the last run_instructions() stopped on, and the FX07 of the
+    // timer loop. Worked out again every run, so never saved.
+    uint8_t idle;
+    uint16_t idle_loop;
+
+    // Everything from here down is set up by whoever hosts the machine rather
+    // than being machine state, init_cpu() leaves it alone.
+
+    Chip8Core core;
+    Chip8Variant variant;
+
+    // The machine's memory_mask + 1 bytes of memory: base_memory, or
+    // big_memory on XO-CHIP. init_cpu() points it at the variant's, which
+    // chip8_set_variant() and chip8_copy() allocate when they need it.
+    uint8_t* memory;
+    uint8_t* big_memory;
+    Chip8Quirks quirks;
+
+    // what init_cpu() seeds the random generator with, so a reset replays
+    // the same random numbers
+    uint64_t seed;
+
+    // CORE_PREDECODED's table, one entry per memory address, decoded_size
+    // of them: 4KB worth until the machine first becomes an XO-CHIP one
+    struct DecodedOp* decoded;
+    uint32_t decoded_size;
+
+    // CORE_BLOCK's translations and the 64 byte pages of memory written
+    // since it last checked them
+    struct BlockCache* blocks;
+    uint64_t dirty_pages;
+
+    // breakpoints and watchpoints, NULL when not debugging, see debug.h
+    struct Debugger* debug;
+
+    // where tick_timers() hands every finished frame, NULL when not
+    // capturing, see capture.h
+    struct Capture* capture;
+
+#ifdef CHIP8_TRACE
+    // where emulate_cycle() sends trace records, NULL when not tracing
+    struct Trace* trace;
+#endif
+
+#ifdef CHIP8_PROFILE
+    // counters emulate_cycle() keeps, NULL when not profiling
+    struct Profile* profile;
+#endif
+
+} Chip8;
+
+Chip8* chip8_create(Chip8Core core, uint64_t seed);
+void chip8_destroy(Chip8* c8);
+bool chip8_set_variant(Chip8* c8, Chip8Variant variant);
+void chip8_set_quirks(Chip8* c8, Chip8Quirks quirks);
+void chip8_set_keys(Chip8* c8, uint16_t keys);
+bool chip8_copy(Chip8* dst, const Chip8* src);
+const uint64_t* chip8_framebuffer(const Chip8* c8);
+uint32_t chip8_display_hash(const Chip8* c8);
+
+void init_cpu(Chip8* c8);
+int load_rom(Chip8* c8, char* filename);
+int load_rom_data(Chip8* c8, const uint8_t* data, size_t size);
+bool emulate_cycle(Chip8* c8);
+void tick_timers(Chip8* c8);
+
+bool select_core(Chip8* c8, Chip8Core core);
+bool size_memory(Chip8* c8, Chip8Variant variant);
+void release_cores(Chip8* c8);
+int run_instructions(Chip8* c8, int budget);
+void skip_idle_run(Chip8* c8, int left);
+int run_switch(Chip8* c8, int budget);
+int run_predecoded(Chip8* c8, int budget);
+int run_block(Chip8* c8, int budget);
+
+// Instructions a headless run gives each 60Hz frame, see run_headless()
+#define HEADLESS_INSTRUCTIONS 16
+
+// Frames a second the timers tick at, and a window run's frame rate
+#define FRAME_RATE      60
+
+uint64_t run_headless(Chip8* c8, uint64_t max_instructions, uint64_t max_frames, uint64_t* frames_run);
+uint64_t end_headless_frame(Chip8* c8, uint64_t instructions_left, uint64_t frames_left);
+uint64_t frame_instructions(uint64_t frame, uint64_t ips);
+void dump_state(const Chip8* c8);
+bool parse_core(const char* name, Chip8Core* core);
+const char* core_name(Chip8Core core);
+bool parse_variant(const char* name, Chip8Variant* variant);
+const char* variant_name(Chip8Variant variant);
+Chip8Variant variant_for_rom(const char* path);
+bool parse_quirks(const char* name, Chip8Quirks* quirks);
+const char* quirks_name(Chip8Quirks quirks);
+Chip8Quirks variant_quirks(Chip8Variant variant);
+double seconds_since(const struct timespec* start);
+
+// Whether the pixel at (x, y) of a packed display is lit on a bitplane.
+static inline bool display_pixel(const uint64_t* display, int plane, int x, int y) {
+    const uint64_t* row = display + (plane * HIRES_HEIGHT + y) * ROW_WORDS;
+    return (row[x >> 6] >> (63 - (x & 63))) & 1;
+}
+
+// The pixel's colour, bit n set when it's lit on plane n.
+static inline int display_color(const uint64_t* display, int x, int y) {
+    return display_pixel(display, 0, x, y) | display_pixel(display, 1, x, y) << 1;
+}
 
 #define error(...) fprintf(stderr, __VA_ARGS__)
 
@@ -0,0 +1,68 @@
+#ifndef CORPUS_H_
+#define CORPUS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// A set of roms loaded once and shared by every machine in a fleet run.
+//
+// Each CorpusRom is a view into memory the corpus owns, machines copy it to
+// 0x200 on reset with load_rom_data() so nothing gets opened or read per
+// instance. Roms come from three kinds of paths:
+// - a packed corpus file (see below), mmapped whole, views point straight
+//   into the mapping
+// - a directory, walked once (subdirectories too), every rom read into one
+//   buffer with a single read each
+// - a plain rom file, read like a directory with one rom in it
+// Anything too big to fit in memory above 0x200 is rejected by its size in
+// the index or directory entry, before a byte of it is read.
+//
+// Packed file layout (host byte order): the 16 byte CorpusHeader, `count`
+// CorpusEntry records, then the names (NUL terminated) and rom data the
+// entries point at. Offsets are from the start of the file.
+
+#define CORPUS_MAGIC    "C8PK"
+#define CORPUS_VERSION  1
+
+#define CORPUS_MAX_ROM  (MEMORY_SIZE - 0x200)
+
+typedef struct CorpusHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+} CorpusHeader;
+
+typedef struct CorpusEntry {
+    uint32_t name_offset;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t reserved;
+} CorpusEntry;
+
+typedef struct CorpusRom {
+    const char* name;
+    const uint8_t* data;
+    uint32_t size;
+} CorpusRom;
+
+typedef struct Corpus {
+    CorpusRom* roms;
+    int count;
+    int capacity;
+    int rejected;           // roms left out for being too big or unreadable
+
+    // mappings and buffers the views point into
+    struct CorpusBacking* backing;
+} Corpus;
+
+void corpus_init(Corpus* corpus);
+void corpus_free(Corpus* corpus);
+bool corpus_add(Corpus* corpus, const char* path);
+bool corpus_is_bundle(const char* path);
+bool corpus_write(const Corpus* corpus, const char* path);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef DEBUG_H_
+#define DEBUG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Breakpoints and write watchpoints.
+//
+// A machine with a Debugger attached (c8->debug) that has anything armed
+// runs through run_debug() instead of its core: it steps emulate_cycle() and
+// tests PC against a bitmap of breakpoints before every instruction, one bit
+// per address of the largest memory. Watchpoints are ranges of memory whose
+// writes stop the run, checked from mem_written(), so only by the storing
+// instructions (FX33, FX55 and XO-CHIP's 5XY2). With nothing armed, or
+// no debugger at all, run_instructions() picks the machine's own core as
+// usual, so the debugger is always built and costs a pointer test per run
+// and per store until it's used.
+//
+// debug_console() drives a machine from text commands, see its help.
+
+#define DEBUG_WATCHPOINTS   16
+
+// Why the last run_debug() stopped short.
+typedef enum DebugStop {
+    DEBUG_NONE,
+    DEBUG_BREAKPOINT,   // PC reached a breakpoint, the instruction there hasn't run
+    DEBUG_WATCHPOINT,   // the instruction at stop_pc wrote to a watched range
+} DebugStop;
+
+typedef struct Watchpoint {
+    uint16_t start;
+    uint16_t end;       // inclusive
+} Watchpoint;
+
+typedef struct Debugger {
+    uint64_t breakpoints[MEMORY_SIZE / 64];
+    int breakpoint_count;
+    Watchpoint watchpoints[DEBUG_WATCHPOINTS];
+    int watchpoint_count;
+
+    // what the last run stopped on
+    uint8_t stop;
+    uint16_t stop_pc;
+    uint16_t stop_addr;     // the watched address that was written
+
+    // a run picking up from a breakpoint runs the instruction it's on
+    bool resume;
+} Debugger;
+
+Debugger* debugger_create(void);
+void debugger_free(Debugger* debug);
+bool debug_set_breakpoint(Debugger* debug, uint16_t addr, bool on);
+bool debug_add_watchpoint(Debugger* debug, uint16_t addr, uint32_t len);
+bool debug_remove_watchpoint(Debugger* debug, uint16_t addr);
+int run_debug(Chip8* c8, int budget);
+void debug_console(Chip8* c8, uint64_t ips, FILE* in, FILE* out);
+
+static inline bool debug_armed(const Debugger* debug) {
+    return debug->breakpoint_count || debug->watchpoint_count;
+}
+
+static inline bool debug_breakpoint(const Debugger* debug, uint16_t addr) {
+    return (debug->breakpoints[addr >> 6] >> (addr & 63)) & 1;
+}
+
+// Called by mem_written() for every store while a debugger is attached,
+// stops the run when it touched a watched range. pc is where the storing
+// instruction was fetched from, it hasn't moved PC on yet.
+static inline void debug_written(Debugger* debug, uint16_t pc, uint16_t addr, uint32_t len, uint16_t mask) {
+    for (int w = 0; w < debug->watchpoint_count; w++) {
+        const Watchpoint* watch = &debug->watchpoints[w];
+        for (uint32_t i = 0; i < len; i++) {
+            uint16_t at = (addr + i) & mask;
+            if (at >= watch->start && at <= watch->end) {
+                debug->stop = DEBUG_WATCHPOINT;
+                debug->stop_pc = pc;
+                debug->stop_addr = at;
+                return;
+            }
+        }
+    }
+}
+
+#endif
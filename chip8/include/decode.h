@@ -0,0 +1,136 @@
+#ifndef DECODE_H_
+#define DECODE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Opcodes decoded once into a handler index plus every operand already
+// pulled out of the instruction, used by the pre-decoded core which keeps
+// one of these per memory address.
+//
+// CHIP8_OPS is the one list of handlers, the enum and anything that needs a
+// table indexed by handler (dispatch labels, names) are generated from it so
+// they can't drift apart. Every *_BAD entry catches encodings the interpreter
+// doesn't implement under that first nibble. The second and fourth lines are
+// SUPER-CHIP and XO-CHIP additions, they only decode for those variants.
+#define CHIP8_OPS(OP) \
+    OP(UNDECODED) \
+    OP(00E0) OP(00EE) OP(0NNN) \
+    OP(00CN) OP(00DN) OP(00FB) OP(00FC) OP(00FD) OP(00FE) OP(00FF) \
+    OP(1NNN) OP(2NNN) OP(3XNN) OP(4XNN) OP(5XY0) OP(6XNN) OP(7XNN) \
+    OP(5XY2) OP(5XY3) \
+    OP(8XY0) OP(8XY1) OP(8XY2) OP(8XY3) OP(8XY4) OP(8XY5) OP(8XY6) OP(8XY7) OP(8XYE) OP(8_BAD) \
+    OP(9XY0) OP(ANNN) OP(BNNN) OP(CXNN) OP(DXYN) \
+    OP(EX9E) OP(EXA1) OP(E_BAD) \
+    OP(FX07) OP(FX0A) OP(FX15) OP(FX18) OP(FX1E) OP(FX29) OP(FX33) OP(FX55) OP(FX65) OP(F_BAD) \
+    OP(F000) OP(FN01) OP(F002) OP(FX30) OP(FX3A) OP(FX75) OP(FX85)
+
+#define CHIP8_OP_ENUM(name) OP_##name,
+typedef enum OpHandler {
+    CHIP8_OPS(CHIP8_OP_ENUM)
+    OP_COUNT
+} OpHandler;
+#undef CHIP8_OP_ENUM
+
+typedef struct DecodedOp {
+    uint8_t handler;    // OpHandler, OP_UNDECODED until the address is first executed
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint16_t nnn;
+    uint16_t op;        // the raw opcode, for tracing and error messages
+} DecodedOp;
+
+static inline uint8_t decode_handler(uint16_t op, Chip8Variant variant) {
+
+    bool super = variant != VARIANT_CHIP8;
+    bool xochip = variant == VARIANT_XOCHIP;
+
+    switch (op >> 12) {
+        case 0x0:
+            if (op == 0x00E0) return OP_00E0;
+            if (op == 0x00EE) return OP_00EE;
+            if (super) {
+                if ((op & 0xFFF0) == 0x00C0) return OP_00CN;
+                if ((op & 0xFFF0) == 0x00D0 && xochip) return OP_00DN;
+                if (op == 0x00FB) return OP_00FB;
+                if (op == 0x00FC) return OP_00FC;
+                if (op == 0x00FD) return OP_00FD;
+                if (op == 0x00FE) return OP_00FE;
+                if (op == 0x00FF) return OP_00FF;
+            }
+            return OP_0NNN;
+        case 0x1: return OP_1NNN;
+        case 0x2: return OP_2NNN;
+        case 0x3: return OP_3XNN;
+        case 0x4: return OP_4XNN;
+        case 0x5:
+            if (xochip && (op & 0xF) == 0x2) return OP_5XY2;
+            if (xochip && (op & 0xF) == 0x3) return OP_5XY3;
+            return OP_5XY0;
+        case 0x6: return OP_6XNN;
+        case 0x7: return OP_7XNN;
+        case 0x8:
+            switch (op & 0xF) {
+                case 0x0: return OP_8XY0;
+                case 0x1: return OP_8XY1;
+                case 0x2: return OP_8XY2;
+                case 0x3: return OP_8XY3;
+                case 0x4: return OP_8XY4;
+                case 0x5: return OP_8XY5;
+                case 0x6: return OP_8XY6;
+                case 0x7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
+            }
+            return OP_8_BAD;
+        case 0x9: return OP_9XY0;
+        case 0xA: return OP_ANNN;
+        case 0xB: return OP_BNNN;
+        case 0xC: return OP_CXNN;
+        case 0xD: return OP_DXYN;
+        case 0xE:
+            if ((op & 0xFF) == 0x9E) return OP_EX9E;
+            if ((op & 0xFF) == 0xA1) return OP_EXA1;
+            return OP_E_BAD;
+        default:
+            if (xochip) {
+                if (op == 0xF000) return OP_F000;
+                if (op == 0xF002) return OP_F002;
+                if ((op & 0xFF) == 0x01) return OP_FN01;
+                if ((op & 0xFF) == 0x3A) return OP_FX3A;
+            }
+            if (super) {
+                if ((op & 0xFF) == 0x30) return OP_FX30;
+                if ((op & 0xFF) == 0x75) return OP_FX75;
+                if ((op & 0xFF) == 0x85) return OP_FX85;
+            }
+            switch (op & 0xFF) {
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x33: return OP_FX33;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+            }
+            return OP_F_BAD;
+    }
+
+}
+
+static inline void decode_op(uint16_t op, Chip8Variant variant, DecodedOp* decoded) {
+    decoded->handler = decode_handler(op, variant);
+    decoded->x = (op & 0x0F00) >> 8;
+    decoded->y = (op & 0x00F0) >> 4;
+    decoded->n = op & 0x000F;
+    decoded->nn = op & 0x00FF;
+    decoded->nnn = op & 0x0FFF;
+    decoded->op = op;
+}
+
+#endif
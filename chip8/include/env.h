@@ -0,0 +1,60 @@
+#ifndef ENV_H_
+#define ENV_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// An environment-style interface for search and reinforcement learning: one
+// rom, any number of machine states running it that can be reset, stepped
+// and cloned.
+//
+//     Env* env = env_create(rom, size, VARIANT_CHIP8, 4096);
+//     Chip8* state = env_reset(env, seed);
+//     const uint64_t* frame = env_step(env, state, keys, 4, &reward);
+//     Chip8* branch = env_clone(env, state);    // explore from here
+//     env_release(env, branch);
+//     env_destroy(env);
+//
+// States come out of a pool of machines allocated in slabs up front, so
+// reset, clone and release never allocate until the pool runs dry (then it
+// grows by another slab). A clone is chip8_copy(), two flat copies of about
+// 6KB for a CHIP-8 rom: its 4KB of memory plus the registers and display.
+// Pooled machines run on the switch core, the other cores' caches would have
+// to be thrown away on every clone.
+
+// Reward for the frame a state just ran, step adds them up over its frames.
+typedef double (*EnvReward)(const Chip8* c8, void* user);
+
+typedef struct Env {
+
+    const uint8_t* rom;     // the host's, has to outlive the Env
+    size_t rom_size;
+    Chip8Variant variant;
+    Chip8Quirks quirks;     // the variant's own unless the host changes it
+
+    // instructions per frame, HEADLESS_INSTRUCTIONS unless the host changes it
+    int instructions_per_frame;
+
+    // called after every frame a step runs, NULL for no reward
+    EnvReward reward;
+    void* user;
+
+    // the pool: slabs of machines and a stack of the free ones
+    struct EnvSlab* slabs;
+    Chip8** free;
+    size_t free_count;
+    size_t capacity;
+
+} Env;
+
+Env* env_create(const uint8_t* rom, size_t rom_size, Chip8Variant variant, size_t capacity);
+void env_destroy(Env* env);
+Chip8* env_reset(Env* env, uint64_t seed);
+const uint64_t* env_step(Env* env, Chip8* c8, uint16_t keys, int frames, double* reward);
+Chip8* env_clone(Env* env, const Chip8* c8);
+void env_release(Env* env, Chip8* c8);
+
+#endif
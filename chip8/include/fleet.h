@@ -0,0 +1,35 @@
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+#include "corpus.h"
+
+// FleetResult.status of an instance no worker got to, every worker that
+// could have run it failed to allocate its machines.
+#define FLEET_NOT_RUN   (-1)
+
+// Result of one machine in a fleet run.
+typedef struct FleetResult {
+    int status;             // 0 when the rom loaded and ran, the load_rom error (or ENOMEM, or FLEET_NOT_RUN) otherwise
+    uint64_t instructions;
+    uint64_t frames;
+    uint32_t display_hash;  // FNV-1a of the final display, for comparing runs
+} FleetResult;
+
+// Run `instances` headless machines spread over a work-stealing pool of
+// `threads` workers (0 picks one per online core). Instance i runs
+// corpus rom i % count on `core` for the given instruction/frame budget, one instance
+// per task, with its random generator seeded from `seed` and i. Machines run as
+// `variant`, or when that's negative as whatever variant_for_rom() makes of each
+// rom's name, under the `quirks` profile or the variant's own when that's negative.
+// With `batch` the instances of each rom run in lockstep batches of up to
+// BATCH_LANES (see include/batch.h) instead of one by one on `core`, same results.
+// Prints a line per instance and an aggregate summary, returns 0 when
+// every instance loaded its rom and ran.
+int run_fleet(const Corpus* corpus, int instances, int threads, Chip8Core core, int variant, int quirks,
+              bool batch, uint64_t max_instructions, uint64_t max_frames, uint64_t seed);
+
+#endif
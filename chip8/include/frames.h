@@ -0,0 +1,68 @@
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// Lock-free triple buffer of finished frames, from the emulator thread to the
+// window.
+//
+// Each side owns one slot outright (the producer's back, the consumer's
+// front) and the third sits in the middle. Publishing swaps the back slot in
+// the middle and consuming swaps the middle out to the front, each a single
+// atomic exchange. So neither side ever waits and the consumer always gets
+// the newest frame. The FRAMES_FRESH bit on the middle index says whether the
+// middle slot holds a frame the consumer hasn't taken yet.
+
+#define FRAMES_FRESH    4u
+
+typedef struct Frame {
+    uint64_t display[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+    bool hires;
+    uint64_t press_time;        // key press this frame was the first to see, 0 for none
+} Frame;
+
+typedef struct Frames {
+    Frame slots[3];
+    _Alignas(64) _Atomic unsigned middle;
+    _Alignas(64) unsigned back;
+    _Alignas(64) unsigned front;
+} Frames;
+
+static inline void frames_init(Frames* frames) {
+    memset(frames->slots, 0, sizeof(frames->slots));
+    frames->back = 0;
+    atomic_init(&frames->middle, 1);
+    frames->front = 2;
+}
+
+// Producer side, the slot to fill in before the next frames_publish().
+static inline Frame* frames_back(Frames* frames) {
+    return &frames->slots[frames->back];
+}
+
+// Producer side, returns true when the frame this one replaced was never
+// consumed. The back slot then still holds that skipped frame.
+static inline bool frames_publish(Frames* frames) {
+    unsigned old = atomic_exchange_explicit(&frames->middle, frames->back | FRAMES_FRESH,
+                                            memory_order_acq_rel);
+    frames->back = old & ~FRAMES_FRESH;
+    return (old & FRAMES_FRESH) != 0;
+}
+
+// Consumer side, swaps the newest frame to the front. Returns NULL when
+// nothing was published since the last call.
+static inline const Frame* frames_consume(Frames* frames) {
+    if (!(atomic_load_explicit(&frames->middle, memory_order_relaxed) & FRAMES_FRESH)) {
+        return NULL;
+    }
+    unsigned old = atomic_exchange_explicit(&frames->middle, frames->front, memory_order_acq_rel);
+    frames->front = old & ~FRAMES_FRESH;
+    return &frames->slots[frames->front];
+}
+
+#endif
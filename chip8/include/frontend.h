@@ -0,0 +1,17 @@
+#ifndef FRONTEND_H_
+#define FRONTEND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The SDL side of mygame, main.c and audio.c are the only things that link SDL.
+
+void init_sdl_display(bool vsync);
+void draw_on_screen(const uint64_t* display, bool hires, uint64_t dirty_rows);
+void sdl_handler(void);
+uint16_t sample_keypad(uint64_t* press_time);
+void print_input_latency(void);
+void stop_display();
+void print_arrays(unsigned char* given_array, int array_size);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+// The window's load governor.
+//
+// The emulator thread tells it, per frame, how many instructions the frame
+// was owed and how many ran (the display wait ends frames early), and per
+// pass of its loop how long it was busy and whether frames ran late or got
+// dropped. Once a second it looks at the share of the time the thread was
+// busy and steps its level: up when the thread is close to falling behind
+// or already did, down again once there's room to spare. Every level gives
+// up some presentation so emulation never has to slow down:
+//
+//     0   everything: run-ahead on (if asked for), every frame drawn
+//     1   no run-ahead
+//     2   every 2nd frame drawn (30 a second)
+//     3   every 4th frame drawn (15 a second)
+//
+// Emulation itself never changes, every frame still runs its full share of
+// instructions and ticks the timers once. When frames still run late on
+// the last level the host can't keep up, which gets reported on stderr as
+// it happens and summed up by governor_report(). Only real-time frames are
+// measured, turbo has no deadlines to keep and is left out of all of it.
+
+#define GOVERNOR_LEVELS     4
+
+// share of the time busy (per mille) above which the level goes up, and
+// below which it comes back down
+#define GOVERNOR_HIGH       800
+#define GOVERNOR_LOW        400
+
+typedef struct Governor {
+    uint64_t freq;              // counter ticks a second
+    int level;
+
+    // the current one second period
+    uint64_t period_start;
+    uint64_t busy;
+    uint64_t frames;
+    uint64_t late;
+    uint64_t dropped;
+
+    // the whole run
+    uint64_t total_frames;
+    uint64_t total_late;
+    uint64_t total_dropped;
+    uint64_t total_busy;
+    uint64_t instructions;
+    uint64_t owed;
+    uint64_t slow_periods;      // seconds the host couldn't keep up even on the last level
+    bool slow;
+} Governor;
+
+void governor_init(Governor* governor, uint64_t freq, uint64_t now);
+void governor_update(Governor* governor, uint64_t now);
+void governor_restart(Governor* governor, uint64_t now);
+void governor_report(const Governor* governor, FILE* out);
+
+// A frame owed `owed` instructions ran `ran` of them.
+static inline void governor_frame(Governor* governor, uint64_t owed, uint64_t ran) {
+    governor->frames++;
+    governor->owed += owed;
+    governor->instructions += ran;
+}
+
+// A pass of the emulator loop kept the thread busy for `ticks`, `late` of
+// its frames ran after their deadline and `dropped` were given up on.
+static inline void governor_pass(Governor* governor, uint64_t ticks, uint64_t late, uint64_t dropped) {
+    governor->busy += ticks;
+    governor->late += late;
+    governor->dropped += dropped;
+}
+
+static inline bool governor_run_ahead(const Governor* governor) {
+    return governor->level == 0;
+}
+
+// Draw every this many frames.
+static inline uint64_t governor_publish_every(const Governor* governor) {
+    return governor->level < 2 ? 1 : 1ull << (governor->level - 1);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef MOVIE_H_
+#define MOVIE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "ring.h"
+
+// Input movies: everything a window run fed the machine, so it can be played
+// back headless and end up in exactly the same state.
+//
+// Given the rom, the variant, the quirk profile, the seed and the
+// instructions per second, the only thing left that decides a run is the
+// keypad mask chip8_set_keys() got on each 60Hz frame. A movie is that mask
+// per frame, run-length encoded: a key change costs a few bytes and a
+// stretch without one, however long, costs the same few bytes.
+//
+// File layout: the 32 byte MovieHeader, then runs back to back until the end
+// of the file, each one the 16 bit keypad mask (host byte order) followed by
+// the number of frames it was held for as a LEB128 varint.
+//
+// Recording pushes a run into a ring every time the keys change and a
+// background thread encodes and writes them, like the trace writer, so the
+// emulator thread never waits on the disk. Playback streams the file through
+// stdio, never holding more than a buffer of it.
+
+#define MOVIE_MAGIC     "C8MV"
+#define MOVIE_VERSION   1
+
+typedef struct MovieHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t variant;
+    uint8_t quirks;
+    uint64_t seed;
+    uint64_t ips;           // instructions per second, see frame_instructions()
+    uint32_t rom_hash;      // FNV-1a of memory from 0x200 up right after the rom loaded
+    uint32_t reserved;
+} MovieHeader;
+
+typedef struct MovieRun {
+    uint16_t keys;
+    uint32_t frames;
+} MovieRun;
+
+typedef struct MovieWriter {
+    RingWriter writer;
+    FILE* file;
+    MovieRun run;       // the run the emulator thread is adding frames to
+} MovieWriter;
+
+typedef struct MovieReader {
+    FILE* file;
+    MovieHeader header;
+} MovieReader;
+
+uint32_t movie_rom_hash(const Chip8* c8);
+
+MovieWriter* movie_record(const char* path, const Chip8* c8, uint64_t ips);
+void movie_frame(MovieWriter* movie, uint16_t keys);
+bool movie_close(MovieWriter* movie);
+
+MovieReader* movie_open(const char* path);
+bool movie_next(MovieReader* movie, MovieRun* run);
+void movie_free(MovieReader* movie);
+uint64_t movie_play(Chip8* c8, MovieReader* movie, uint64_t max_instructions, uint64_t max_frames, uint64_t* frames_run);
+
+#endif
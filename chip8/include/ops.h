@@ -0,0 +1,756 @@
+#ifndef OPS_H_
+#define OPS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "decode.h"
+#include "debug.h"
+
+// What each instruction actually does, shared by every interpreter core so
+// switching cores can only change how fast we get somewhere, never where we
+// end up. The cores only differ in how they get from an opcode to one of
+// these, the operands come in already pulled out of the opcode:
+//
+// X: second nibble is for grabbing of the 16 registers, VX from V0-VF;
+// Y: third nibble is also for grabbing a register VY, from V0-VF;
+// N: 4th nibble a 4-bit number
+// NN: second byte (3rd and 4th nibbles), an 8-bit immediate number
+// NNN: 2nd, 3rd, 4th nibbles, 12-bit immediate mem address.
+//
+// Everything that writes to memory has to go through mem_written() so cores
+// that cache decoded instructions can throw away what the write changed, and
+// so the debugger's watchpoints see it.
+//
+// Addresses wrap at c8->memory_mask, so a CHIP-8 rom sees 4KB and an XO-CHIP
+// one all 64KB.
+//
+// The handful of instructions platforms disagree on take the machine's quirk
+// profile as a parameter. Every core is built once per profile and passes it
+// in as a constant, so the QUIRK_ tests below fold away and a core only ever
+// contains the one behaviour it was built for.
+//
+// XO-CHIP machines get their own build of each profile too, with
+// QUIRKS_XO_VARIANT or'd into it, so the variant checks in the hot ops fold
+// away the same way. core_profile() gives the profile a machine runs under.
+
+// built for an XO-CHIP machine, whatever its quirk profile, the Chip8Quirks
+// values all fit below it
+#define QUIRKS_XO_VARIANT       0x4
+#define QUIRK_PROFILE(q)        ((q) & (QUIRKS_XO_VARIANT - 1))
+
+// 8XY1/8XY2/8XY3 clear VF, the VIP's logic ops went through VF
+#define QUIRK_VF_RESET(q)       (QUIRK_PROFILE(q) == QUIRKS_VIP)
+// 8XY6/8XYE shift VX in place instead of shifting VY into VX
+#define QUIRK_SHIFT_VX(q)       (QUIRK_PROFILE(q) == QUIRKS_CHIP48 || QUIRK_PROFILE(q) == QUIRKS_SCHIP)
+// BNNN reads as BXNN and jumps to XNN + VX instead of NNN + V0
+#define QUIRK_JUMP_VX(q)        (QUIRK_PROFILE(q) == QUIRKS_CHIP48 || QUIRK_PROFILE(q) == QUIRKS_SCHIP)
+// DXYN waits for the next frame, nothing else runs until then
+#define QUIRK_DISPLAY_WAIT(q)   (QUIRK_PROFILE(q) == QUIRKS_VIP)
+// sprites wrap around the screen edges instead of being clipped
+#define QUIRK_WRAP(q)           (QUIRK_PROFILE(q) == QUIRKS_XOCHIP)
+// how far FX55/FX65 move I: past VX, to VX (CHIP-48's off by one), or not at all
+#define QUIRK_MEMORY_STEP(q, x) (QUIRK_PROFILE(q) == QUIRKS_SCHIP ? 0 : QUIRK_PROFILE(q) == QUIRKS_CHIP48 ? (x) : (x) + 1)
+// XO-CHIP's extra instructions decode, and skips step over F000 NNNN whole
+#define QUIRK_XO_VARIANT(q)     (((q) & QUIRKS_XO_VARIANT) != 0)
+
+// The profile a core has to be built with to run this machine.
+static inline int core_profile(const Chip8* c8) {
+    return c8->quirks | (c8->variant == VARIANT_XOCHIP ? QUIRKS_XO_VARIANT : 0);
+}
+
+// The bit of c8->dirty_pages a 64 byte page maps to. 4KB of pages fit in the
+// word, XO-CHIP's pages 4KB apart share a bit.
+#define DIRTY_PAGE(addr) (((addr) >> 6) & 63)
+
+static inline void mem_written(Chip8* c8, uint16_t addr, uint32_t len) {
+    if (c8->debug != NULL) {
+        debug_written(c8->debug, c8->PC, addr, len, c8->memory_mask);
+    }
+
+    // CORE_BLOCK only wants to know which 64 byte pages changed
+    uint16_t mask = c8->memory_mask;
+    uint16_t last = addr + len - 1;
+    c8->dirty_pages |= 1ull << DIRTY_PAGE(last & mask);
+    for (uint32_t page = 0; page < len; page += 64) {
+        c8->dirty_pages |= 1ull << DIRTY_PAGE((addr + page) & mask);
+    }
+
+    if (c8->decoded == NULL) {
+        return;
+    }
+    // the entry one byte before the write decoded its second byte from it
+    for (uint32_t i = 0; i <= len; i++) {
+        c8->decoded[(addr + i - 1) & mask].handler = OP_UNDECODED;
+    }
+}
+
+// How far a taken skip jumps, XO-CHIP's F000 NNNN is four bytes long and
+// gets skipped as a whole.
+static inline uint16_t skip_size(const Chip8* c8, int quirks) {
+    uint16_t next = c8->PC + 2;
+    if (QUIRK_XO_VARIANT(quirks) && c8->memory[next & c8->memory_mask] == 0xF0
+            && c8->memory[(next + 1) & c8->memory_mask] == 0x00) {
+        return 4;
+    }
+    return 2;
+}
+
+// Dirty row bits for the top `height` rows of the display.
+static inline uint64_t rows_mask(int height) {
+    return height == 64 ? ~0ull : (1ull << height) - 1;
+}
+
+// PCG32 (XSH RR), a 64-bit LCG step with a permuted 32-bit output. Per
+// machine so instances on different threads never share state, and seeded
+// once so a run with the same seed gets the same numbers.
+#define PCG_MULTIPLIER  6364136223846793005ull
+#define PCG_INCREMENT   1442695040888963407ull
+
+static inline uint32_t chip8_random(Chip8* c8) {
+    uint64_t old = c8->rng;
+    c8->rng = old * PCG_MULTIPLIER + PCG_INCREMENT;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+static inline void seed_random(Chip8* c8, uint64_t seed) {
+    c8->rng = 0;
+    chip8_random(c8);
+    c8->rng += seed;
+    chip8_random(c8);
+}
+
+static inline void op_00e0(Chip8* c8) {
+    // clears the selected planes, a store per word, only rows that had
+    // something on them count as changed
+    int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(c8->planes & (1 << plane))) {
+            continue;
+        }
+        for (int row = 0; row < height; row++) {
+            uint64_t* words = c8->display[plane][row];
+            if (words[0] | words[1]) {
+                c8->dirty_rows |= 1ull << row;
+                words[0] = 0;
+                words[1] = 0;
+            }
+        }
+    }
+    c8->PC += 2;
+}
+
+// The scrolls move the selected planes by whole rows (a memmove per plane)
+// or by 4 pixels (a shift per word), in pixels of the current resolution.
+static inline void op_00cn(Chip8* c8, uint8_t n) {
+    // scroll down N rows, SUPER-CHIP
+    int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    if (n > height) {
+        n = height;
+    }
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (c8->planes & (1 << plane)) {
+            uint64_t (*rows)[ROW_WORDS] = c8->display[plane];
+            memmove(rows[n], rows[0], (height - n) * sizeof(rows[0]));
+            memset(rows[0], 0, n * sizeof(rows[0]));
+        }
+    }
+    c8->dirty_rows |= rows_mask(height);
+    c8->PC += 2;
+}
+
+static inline void op_00dn(Chip8* c8, uint8_t n) {
+    // scroll up N rows, XO-CHIP
+    int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    if (n > height) {
+        n = height;
+    }
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (c8->planes & (1 << plane)) {
+            uint64_t (*rows)[ROW_WORDS] = c8->display[plane];
+            memmove(rows[0], rows[n], (height - n) * sizeof(rows[0]));
+            memset(rows[height - n], 0, n * sizeof(rows[0]));
+        }
+    }
+    c8->dirty_rows |= rows_mask(height);
+    c8->PC += 2;
+}
+
+static inline void op_00fb(Chip8* c8) {
+    // scroll right 4 pixels, what falls off the right edge is gone
+    int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(c8->planes & (1 << plane))) {
+            continue;
+        }
+        for (int row = 0; row < height; row++) {
+            uint64_t* words = c8->display[plane][row];
+            if (c8->hires) {
+                words[1] = words[1] >> 4 | words[0] << 60;
+            }
+            words[0] >>= 4;
+        }
+    }
+    c8->dirty_rows |= rows_mask(height);
+    c8->PC += 2;
+}
+
+static inline void op_00fc(Chip8* c8) {
+    // scroll left 4 pixels
+    int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(c8->planes & (1 << plane))) {
+            continue;
+        }
+        for (int row = 0; row < height; row++) {
+            uint64_t* words = c8->display[plane][row];
+            if (c8->hires) {
+                words[0] = words[0] << 4 | words[1] >> 60;
+                words[1] <<= 4;
+            } else {
+                words[0] <<= 4;
+            }
+        }
+    }
+    c8->dirty_rows |= rows_mask(height);
+    c8->PC += 2;
+}
+
+static inline void op_00fd(Chip8* c8) {
+    // exit the interpreter, the rom stays parked here without the unknown
+    // opcode complaint every time it runs
+    (void)c8;
+}
+
+static inline void op_00fe_00ff(Chip8* c8, bool hires) {
+    // 00FE low, 00FF high resolution, switching clears every plane
+    c8->hires = hires;
+    memset(c8->display, 0, sizeof(c8->display));
+    c8->dirty_rows = ~0ull;
+    c8->PC += 2;
+}
+
+static inline void op_00ee(Chip8* c8) {
+    // Return from subroutine setting PC to address at top of 
+    // stack, then subtracting one from the stack pointer.
+    c8->PC = c8->stack[c8->stack_idx & 0xF];
+    c8->stack_idx--;
+    c8->PC += 2;
+}
+
+static inline void op_unknown(Chip8* c8, uint16_t op) {
+    // Includes 0x0NNN, which is made to jump to a machine code routine at NNN,
+    // according to one of the guides I'm following, this instruction does not
+    // get implemented in modern interpreters. PC doesn't move so the rom stays
+    // stuck here, same as it always has.
+    (void)c8;
+    error("[ERROR] Unknown opcode encountered: 0x%X\n", op);
+}
+
+static inline void op_1nnn(Chip8* c8, uint16_t nnn) {
+    // jump to location NNN, ie setting the PC to NNN.
+    c8->PC = nnn;
+}
+
+static inline void op_2nnn(Chip8* c8, uint16_t nnn) {
+    // Call subroutine at NNN, interpreter increments the stack pointer,
+    // and puts the current PC on the top of the stack, the PC is then set to NNN
+    c8->stack_idx++;
+    c8->stack[c8->stack_idx & 0xF] = c8->PC;
+    c8->PC = nnn;
+}
+
+static inline void op_3xnn(Chip8* c8, uint8_t x, uint8_t nn, int quirks) {
+    // skips the next instruction if VX = NN;
+    if (c8->V[x] == nn) {
+        c8->PC += skip_size(c8, quirks);
+    }
+    c8->PC += 2;
+}
+
+static inline void op_4xnn(Chip8* c8, uint8_t x, uint8_t nn, int quirks) {
+    // skips the instruction if VX != NN;
+    if (c8->V[x] != nn) {
+        c8->PC += skip_size(c8, quirks);
+    }
+    c8->PC += 2;
+}
+
+static inline void op_5xy0(Chip8* c8, uint8_t x, uint8_t y, int quirks) {
+    // skip the next instruction if VX = VY
+    if (c8->V[x] == c8->V[y]) {
+        c8->PC += skip_size(c8, quirks);
+    }
+    c8->PC += 2;
+}
+
+static inline void op_5xy2(Chip8* c8, uint8_t x, uint8_t y) {
+    // XO-CHIP: store VX to VY (either way round) at I, I doesn't move
+    int step = x <= y ? 1 : -1;
+    int count = abs(x - y) + 1;
+    for (int i = 0; i < count; i++) {
+        c8->memory[(c8->I + i) & c8->memory_mask] = c8->V[x + i * step];
+    }
+    mem_written(c8, c8->I, count);
+    c8->PC += 2;
+}
+
+static inline void op_5xy3(Chip8* c8, uint8_t x, uint8_t y) {
+    // XO-CHIP: load VX to VY (either way round) from I, I doesn't move
+    int step = x <= y ? 1 : -1;
+    int count = abs(x - y) + 1;
+    for (int i = 0; i < count; i++) {
+        c8->V[x + i * step] = c8->memory[(c8->I + i) & c8->memory_mask];
+    }
+    c8->PC += 2;
+}
+
+static inline void op_6xnn(Chip8* c8, uint8_t x, uint8_t nn) {
+    // sets V[X] to NN
+    c8->V[x] = nn;
+    c8->PC += 2;
+}
+
+static inline void op_7xnn(Chip8* c8, uint8_t x, uint8_t nn) {
+    // sets VX to value at VX + NN, no carry flag;
+    c8->V[x] += nn;
+    c8->PC += 2;
+}
+
+static inline void op_8xy0(Chip8* c8, uint8_t x, uint8_t y) {
+    // Set VX to VY 
+    c8->V[x] = c8->V[y];
+    c8->PC += 2;
+}
+
+static inline void op_8xy1(Chip8* c8, uint8_t x, uint8_t y, int quirks) {
+    // set VX to VX OR VY; do bitwise OR on the registers
+    c8->V[x] = c8->V[x] | c8->V[y];
+    if (QUIRK_VF_RESET(quirks)) {
+        c8->V[15] = 0;
+    }
+    c8->PC += 2;
+}
+
+static inline void op_8xy2(Chip8* c8, uint8_t x, uint8_t y, int quirks) {
+    // set VX to VX AND VY; do bitwise AND;
+    c8->V[x] = c8->V[x] & c8->V[y];
+    if (QUIRK_VF_RESET(quirks)) {
+        c8->V[15] = 0;
+    }
+    c8->PC += 2;
+}
+
+static inline void op_8xy3(Chip8* c8, uint8_t x, uint8_t y, int quirks) {
+    // set VX to VX XOR VY; do bitwise XOR;
+    c8->V[x] = c8->V[x] ^ c8->V[y];
+    if (QUIRK_VF_RESET(quirks)) {
+        c8->V[15] = 0;
+    }
+    c8->PC += 2;
+}
+
+static inline void op_8xy4(Chip8* c8, uint8_t x, uint8_t y) {
+    // set VX to VX + VY; use VF as carry if result is more than 255;
+    // VF set to 1 in that case, otherwise 0 and only lowest 8 bits are 
+    // kept and stored in VX. The flag goes in last so it wins when X is F.
+    uint16_t sum = c8->V[x] + c8->V[y];
+    // Do bitwise and to keep the lower 8 bits
+    c8->V[x] = sum & 0xFF;
+    c8->V[0xF] = sum > 255 ? 1 : 0;
+    c8->PC += 2;
+}
+
+static inline void op_8xy5(Chip8* c8, uint8_t x, uint8_t y) {
+    // Set VX to VX - VY, VF set to NOT Borrow;
+    // if VX > VY then VF = 1, 0 otherwise;
+    uint8_t diff = c8->V[x] - c8->V[y];
+    c8->V[0xF] = c8->V[x] >= c8->V[y] ? 1 : 0;
+    if (x != 0xF) {
+        c8->V[x] = diff;
+    }
+    c8->PC += 2;
+}
+
+static inline void op_8xy6(Chip8* c8, uint8_t x, uint8_t y, int quirks) {
+    // Place the value of V[Y] into V[X], shift the value in V[X] 1
+    // bit to the right, store the shifted bit into V[F]. CHIP-48 and
+    // SUPER-CHIP shift V[X] where it is.
+    if (!QUIRK_SHIFT_VX(quirks)) {
+        c8->V[x] = c8->V[y];
+    }
+    int shifted_bit = c8->V[x] & 0b00000001;
+    c8->V[x] /= 2;
+    c8->V[0xF] = shifted_bit ? 1 : 0;
+    c8->PC += 2;
+}
+
+static inline void op_8xy7(Chip8* c8, uint8_t x, uint8_t y) {
+    // set VX to VY - VX, if VY > VX then VF = 1; 0 otherwise
+    uint8_t diff = c8->V[y] - c8->V[x];
+    c8->V[0xF] = c8->V[y] >= c8->V[x] ? 1 : 0;
+    if (x != 0xF) {
+        c8->V[x] = diff;
+    }
+    c8->PC += 2;
+}
+
+static inline void op_8xye(Chip8* c8, uint8_t x, uint8_t y, int quirks) {
+    // If the most significant bit of VX is 1, then VF is set to 1
+    // otherwise it's set to 0, then V[X] is multiplied by 2; V[Y] gets
+    // copied in first, same as 8XY6
+    if (!QUIRK_SHIFT_VX(quirks)) {
+        c8->V[x] = c8->V[y];
+    }
+    int shifted_bit = c8->V[x] & 0b10000000;
+    c8->V[x] *= 2;
+    c8->V[0xF] = shifted_bit ? 1 : 0;
+    c8->PC += 2;
+}
+
+static inline void op_9xy0(Chip8* c8, uint8_t x, uint8_t y, uint8_t n, int quirks) {
+    // Skip the next instruction if VX != VY;
+    if (n == 0 && c8->V[x] != c8->V[y]) {
+        c8->PC += skip_size(c8, quirks);
+    }
+    c8->PC += 2;
+}
+
+static inline void op_annn(Chip8* c8, uint16_t nnn) {
+    // Set special register I to NNN;
+    c8->I = nnn;
+    c8->PC += 2;
+}
+
+static inline void op_bnnn(Chip8* c8, uint8_t x, uint16_t nnn, int quirks) {
+    // set PC to NNN + V0; or to XNN + VX for CHIP-48 and SUPER-CHIP
+    c8->PC = c8->V[QUIRK_JUMP_VX(quirks) ? x : 0] + nnn;
+}
+
+static inline void op_cxnn(Chip8* c8, uint8_t x, uint8_t nn) {
+    // Set V[X] to a random byte and NN, ie generate a rand int
+    // from 0 to 255 and then do bitwise AND with NN and store it in V[X]
+    c8->V[x] = (chip8_random(c8) >> 24) & nn;
+    c8->PC += 2;
+}
+
+// XOR one sprite row onto a display row, `sprite` holds its pixels in the top
+// bits and x is the column of the first one. Returns the pixels it switched
+// off. Whatever goes past the right edge is clipped, or wraps back round to
+// the left edge when `wrap` is set.
+static inline uint64_t draw_row(uint64_t* words, int row_words, uint64_t sprite, int x, bool wrap) {
+    int word = x >> 6;
+    int shift = x & 63;
+    uint64_t bits = sprite >> shift;
+    uint64_t collision = words[word] & bits;
+    words[word] ^= bits;
+    if (shift && (wrap || word + 1 < row_words)) {
+        int next = (word + 1) & (row_words - 1);
+        bits = sprite << (64 - shift);
+        collision |= words[next] & bits;
+        words[next] ^= bits;
+    }
+    return collision;
+}
+
+static inline void op_dxyn(Chip8* c8, uint8_t x, uint8_t y, uint8_t n, int quirks) {
+    // display a sprite starting at memory location I at (VX, VY),
+    // use VF for collision bool, Sprites that are read in are XORed onto the display
+    // if any pixels are erased because of this, VF is set to 1, otherwise to 0.
+    // The starting position wraps around the screen, anything past the edge
+    // from there is clipped (XO-CHIP wraps that too, see QUIRK_WRAP).
+    //
+    // Each sprite row gets shifted into place in the row's 64-bit words and
+    // XORed onto them in one go, rows past the bottom of the screen are just
+    // never drawn. SUPER-CHIP's DXY0 is 16x16, two bytes a row. XO-CHIP draws
+    // on every selected plane, each with its own sprite right after the last.
+
+    bool wide = n == 0 && c8->variant != VARIANT_CHIP8;
+    uint64_t collision = 0;
+
+    if (!c8->hires && !wide && c8->planes == 1) {
+        // the plain CHIP-8 case, a byte a row into the row's first word.
+        // N is the height of the sprite being displayed.
+        // Get X and Y coords from VX and VY;
+        uint8_t x_coord = c8->V[x] % SCREEN_WIDTH; // modulo to 'wrap' around in case sprite is too big
+        uint8_t y_coord = c8->V[y] % SCREEN_HEIGHT; // same reasoning for modulo here.
+        int rows = n;
+        if (!QUIRK_WRAP(quirks) && y_coord + rows > SCREEN_HEIGHT) {
+            rows = SCREEN_HEIGHT - y_coord;
+        }
+
+        for (int nth_byte = 0; nth_byte < rows; nth_byte++) {
+            uint64_t sprite = (uint64_t)c8->memory[(c8->I + nth_byte) & c8->memory_mask] << (SCREEN_WIDTH - 8);
+            if (QUIRK_WRAP(quirks) && x_coord) {
+                // a rotate puts what falls off the right edge on the left
+                sprite = sprite >> x_coord | sprite << (SCREEN_WIDTH - x_coord);
+            } else {
+                sprite >>= x_coord;
+            }
+            // a pixel already on that will be switched off sets the collision flag
+            int row = (y_coord + nth_byte) & (SCREEN_HEIGHT - 1);
+            uint64_t* word = &c8->display[0][row][0];
+            collision |= *word & sprite;
+            *word ^= sprite;
+            if (sprite) {
+                c8->dirty_rows |= 1ull << row;
+            }
+        }
+    } else {
+        int width = c8->hires ? HIRES_WIDTH : SCREEN_WIDTH;
+        int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+        int sprite_rows = wide ? 16 : n;
+        int x_coord = c8->V[x] & (width - 1);
+        int y_coord = c8->V[y] & (height - 1);
+        int rows = sprite_rows;
+        if (!QUIRK_WRAP(quirks) && y_coord + rows > height) {
+            rows = height - y_coord;
+        }
+
+        uint16_t addr = c8->I;
+        for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+            if (!(c8->planes & (1 << plane))) {
+                continue;
+            }
+            for (int nth_row = 0; nth_row < rows; nth_row++) {
+                uint64_t sprite;
+                if (wide) {
+                    uint16_t at = addr + nth_row * 2;
+                    sprite = (uint64_t)(c8->memory[at & c8->memory_mask] << 8
+                                        | c8->memory[(at + 1) & c8->memory_mask]) << 48;
+                } else {
+                    sprite = (uint64_t)c8->memory[(addr + nth_row) & c8->memory_mask] << 56;
+                }
+                int row = (y_coord + nth_row) & (height - 1);
+                collision |= draw_row(c8->display[plane][row], width >> 6, sprite, x_coord, QUIRK_WRAP(quirks));
+                if (sprite) {
+                    c8->dirty_rows |= 1ull << row;
+                }
+            }
+            addr += wide ? 32 : sprite_rows;
+        }
+    }
+    c8->V[0xF] = collision != 0;
+
+    c8->draw_flag = 1;
+    c8->PC += 2;
+}
+
+static inline void op_ex9e(Chip8* c8, uint8_t x, int quirks) {
+    // skip instruction if the key with the value of VX is pressed
+    if (c8->keypad[c8->V[x] & 0xF]) {
+        c8->PC += skip_size(c8, quirks);
+    }
+    c8->PC += 2;
+}
+
+static inline void op_exa1(Chip8* c8, uint8_t x, int quirks) {
+    // skip instruction if key with value of VX is NOT pressed
+    if (!c8->keypad[c8->V[x] & 0xF]) {
+        c8->PC += skip_size(c8, quirks);
+    }
+    c8->PC += 2;
+}
+
+static inline void op_fx07(Chip8* c8, uint8_t x) {
+    // set VX to the value of the delay timer;
+    c8->V[x] = c8->delay_timer;
+    c8->PC += 2;
+}
+
+static inline void op_fx0a(Chip8* c8, uint8_t x) {
+    // Wait for a keypress, then store the value in VX
+    // All execution should stop until a key is pressed. Done by not incrementing
+    // PC until a keypress is found, and then until that key is released again.
+    if (c8->key_found && (c8->key_pressed != 255)) {
+        if (!c8->keypad[c8->key_pressed]) {
+            c8->key_found = false;
+            c8->key_pressed = 255;
+            c8->PC += 2;
+        }
+    }
+
+    for (int i = 0; i < 16; i++) {
+        if (c8->keypad[i]) {
+            c8->V[x] = i;
+            c8->key_found = true;
+            c8->key_pressed = i;
+            break;
+        }
+    }
+}
+
+// The idle loops, checked by every core where they run so the rest of the
+// run can be skipped instead of spun through (see run_instructions()). While
+// a machine sits in one nothing but PC changes until the timers tick or the
+// keypad changes, and neither happens in the middle of a run. Profiled
+// machines spin for real so the counts stay what the rom does.
+
+// Call right after FX07: whether it starts a loop waiting on the delay timer,
+// FX07 then a 3XNN/4XNN on VX that doesn't skip with this value then a jump
+// back to the FX07. Marks the machine IDLE_TIMER if so.
+static inline bool idle_on_timer(Chip8* c8, uint8_t x) {
+#ifdef CHIP8_PROFILE
+    if (c8->profile) {
+        return false;
+    }
+#endif
+    uint16_t pc = c8->PC & c8->memory_mask;
+    uint16_t skip = c8->memory[pc] << 8 | c8->memory[(pc + 1) & c8->memory_mask];
+    uint16_t jump = c8->memory[(pc + 2) & c8->memory_mask] << 8 | c8->memory[(pc + 3) & c8->memory_mask];
+    // a 1NNN can't jump back to an FX07 above 0xFFF
+    uint16_t loop = c8->PC - 2;
+    if (loop > 0xFFF || jump != (0x1000 | loop) || ((skip >> 8) & 0xF) != x) {
+        return false;
+    }
+    bool spins = false;
+    if ((skip >> 12) == 0x3) {
+        spins = c8->V[x] != (skip & 0xFF);
+    } else if ((skip >> 12) == 0x4) {
+        spins = c8->V[x] == (skip & 0xFF);
+    }
+    if (spins) {
+        c8->idle = IDLE_TIMER;
+        c8->idle_loop = loop;
+    }
+    return spins;
+}
+
+// Call instead of FX0A: whether running it now would change nothing, no key
+// down yet or the key it saw still held and picked again. Marks the machine
+// IDLE_KEY if so, the FX0A counts as run.
+static inline bool idle_on_key(Chip8* c8, uint8_t x) {
+#ifdef CHIP8_PROFILE
+    if (c8->profile) {
+        return false;
+    }
+#endif
+    int first = 16;
+    for (int i = 0; i < 16; i++) {
+        if (c8->keypad[i]) {
+            first = i;
+            break;
+        }
+    }
+    bool waiting;
+    if (!c8->key_found) {
+        waiting = first == 16;
+    } else {
+        waiting = c8->key_pressed == first && c8->V[x] == first;
+    }
+    if (waiting) {
+        c8->idle = IDLE_KEY;
+    }
+    return waiting;
+}
+
+static inline void op_fx15(Chip8* c8, uint8_t x) {
+    // opposite of 0xFX07 where this time delay timer is set to value of VX;
+    c8->delay_timer = c8->V[x];
+    c8->PC += 2;
+}
+
+static inline void op_fx18(Chip8* c8, uint8_t x) {
+    // set sound timer to VX
+    c8->sound_timer = c8->V[x];
+    c8->PC += 2;
+}
+
+static inline void op_fx1e(Chip8* c8, uint8_t x) {
+    // set I = I + VX;
+    c8->I += c8->V[x];
+    c8->PC += 2;
+}
+
+static inline void op_fx29(Chip8* c8, uint8_t x) {
+    // set I = location of the 4x5 sprite for the digit in VX's low nibble,
+    // the font sits at 0 five bytes a digit
+    c8->I = (c8->V[x] & 0xF) * 5;
+    c8->PC += 2;
+}
+
+static inline void op_fx30(Chip8* c8, uint8_t x) {
+    // SUPER-CHIP: set I = location of the big 8x10 sprite for digit VX
+    c8->I = BIG_FONT_ADDR + (c8->V[x] & 0xF) * 10;
+    c8->PC += 2;
+}
+
+static inline void op_fx33(Chip8* c8, uint8_t x) {
+    // Store BCD representation of VX in mem locations I, I + 1, I + 2;
+    // take the decimal value of VX, placing hundreds digit at I, tens at I + 1, ones at I + 2;
+    unsigned char vx_value = c8->V[x];
+    c8->memory[c8->I & c8->memory_mask] = vx_value / 100;
+    c8->memory[(c8->I + 1) & c8->memory_mask] = (vx_value % 100) / 10;
+    c8->memory[(c8->I + 2) & c8->memory_mask] = vx_value % 10;
+    mem_written(c8, c8->I, 3);
+    c8->PC += 2;
+}
+
+static inline void op_fx55(Chip8* c8, uint8_t x, int quirks) {
+    // Store registers V0-VX in memory start at location I;
+    // Copy the values from the registers into memory starting at I
+    for (int i = 0; i <= x; i++) {
+        c8->memory[(c8->I + i) & c8->memory_mask] = c8->V[i];
+    }
+    mem_written(c8, c8->I, x + 1);
+    c8->I += QUIRK_MEMORY_STEP(quirks, x);
+    c8->PC += 2;
+}
+
+static inline void op_fx65(Chip8* c8, uint8_t x, int quirks) {
+    // Read registers V0-VX from memory starting at location I;
+    // Read values from memory into the registers.
+    for (int i = 0; i <= x; i++) {
+        c8->V[i] = c8->memory[(c8->I + i) & c8->memory_mask];
+    }
+    c8->I += QUIRK_MEMORY_STEP(quirks, x);
+    c8->PC += 2;
+}
+
+static inline void op_fx75(Chip8* c8, uint8_t x) {
+    // SUPER-CHIP: save V0-VX to the RPL user flags
+    memcpy(c8->rpl, c8->V, x + 1);
+    c8->PC += 2;
+}
+
+static inline void op_fx85(Chip8* c8, uint8_t x) {
+    // SUPER-CHIP: load V0-VX from the RPL user flags
+    memcpy(c8->V, c8->rpl, x + 1);
+    c8->PC += 2;
+}
+
+static inline void op_f000(Chip8* c8) {
+    // XO-CHIP: I = the 16-bit address in the next word, so 4 bytes long
+    uint16_t at = c8->PC + 2;
+    c8->I = c8->memory[at & c8->memory_mask] << 8 | c8->memory[(at + 1) & c8->memory_mask];
+    c8->PC += 4;
+}
+
+static inline void op_fn01(Chip8* c8, uint8_t n) {
+    // XO-CHIP: select the bitplanes the drawing instructions work on
+    c8->planes = n & 3;
+    c8->PC += 2;
+}
+
+static inline void op_f002(Chip8* c8) {
+    // XO-CHIP: load the 16 byte audio pattern from I
+    for (int i = 0; i < 16; i++) {
+        c8->pattern[i] = c8->memory[(c8->I + i) & c8->memory_mask];
+    }
+    c8->has_pattern = true;
+    c8->PC += 2;
+}
+
+static inline void op_fx3a(Chip8* c8, uint8_t x) {
+    // XO-CHIP: set the audio pitch to VX
+    c8->pitch = c8->V[x];
+    c8->PC += 2;
+}
+
+#endif
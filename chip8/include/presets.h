@@ -0,0 +1,38 @@
+#ifndef PRESETS_H_
+#define PRESETS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Per-rom speed presets, looked up by the rom's hash.
+//
+// Roms were written for interpreters running anywhere from a few hundred to
+// thousands of instructions a second, and nothing in a rom says which. A
+// presets file gives the ones that need it their own rate, one per line:
+//
+//     # hash    ips    anything else is a comment
+//     1A2B3C4D  500    Tetris
+//
+// The hash is the FNV-1a one movies check (movie_rom_hash()), the window
+// prints it when it loads a rom. Blank lines and lines starting with '#'
+// are skipped.
+
+typedef struct Preset {
+    uint32_t hash;
+    uint64_t ips;
+} Preset;
+
+typedef struct Presets {
+    Preset* presets;
+    int count;
+    int capacity;
+} Presets;
+
+void presets_init(Presets* presets);
+void presets_free(Presets* presets);
+bool presets_load(Presets* presets, const char* path, int* bad_line);
+uint64_t presets_ips(const Presets* presets, uint32_t hash);
+
+#endif
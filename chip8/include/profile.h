@@ -0,0 +1,147 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+
+#include "chip8.h"
+#include "decode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Opt-in execution profile.
+//
+// With CHIP8_PROFILE on, emulate_cycle() counts every instruction by
+// handler, and the address it ran from. For every PROFILE_SAMPLE_PERIOD-th
+// instruction it also times the instruction into a per-handler histogram of
+// power of two timestamp counter buckets. On top of that it counts DXYNs
+// that hit the clipping path, FX0A executions that kept waiting, and draws
+// per 60Hz frame. A profiled machine always steps through emulate_cycle(),
+// whatever core it has selected.
+//
+// profile_write() appends a JSON snapshot. The frontend writes one on
+// SIGUSR1 or F12 and when the run ends. Without CHIP8_PROFILE the hooks
+// compile to nothing and Chip8 has no profile pointer at all.
+
+#define PROFILE_SAMPLE_PERIOD   64      // power of two
+#define PROFILE_BUCKETS         32      // bucket b holds latencies in [2^b, 2^(b+1))
+#define PROFILE_TOP_PCS         16
+#define PROFILE_MAX_DRAWS       16      // the last draws per frame bucket is "this many or more"
+
+typedef struct Profile {
+    uint64_t instructions;
+    uint64_t count[OP_COUNT];
+    uint64_t latency[OP_COUNT][PROFILE_BUCKETS];
+    uint64_t pc_hits[MEMORY_SIZE];
+
+    uint64_t dxyn_clipped;
+    uint64_t fx0a_spins;
+
+    uint64_t frames;
+    uint32_t frame_draws;
+    uint64_t draws_per_frame[PROFILE_MAX_DRAWS + 1];
+} Profile;
+
+// set from the SIGUSR1 handler, the frontend checks it once per frame
+extern volatile sig_atomic_t profile_requested;
+
+Profile* profile_create(void);
+void profile_free(Profile* profile);
+void profile_install_signal(void);
+void profile_write(const Profile* profile, FILE* out);
+
+static inline uint64_t profile_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+// Work out the clipping test before DXYN runs, it can overwrite VF which
+// may be one of its own coordinates.
+static inline void profile_before(Profile* profile, const Chip8* c8, uint16_t op) {
+    if ((op >> 12) == 0xD) {
+        int width = c8->hires ? HIRES_WIDTH : SCREEN_WIDTH;
+        int height = c8->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+        bool wide = (op & 0xF) == 0 && c8->variant != VARIANT_CHIP8;
+        int x = c8->V[(op >> 8) & 0xF] & (width - 1);
+        int y = c8->V[(op >> 4) & 0xF] & (height - 1);
+        if (x + (wide ? 16 : 8) > width || y + (wide ? 16 : op & 0xF) > height) {
+            profile->dxyn_clipped++;
+        }
+    }
+}
+
+static inline void profile_after(Profile* profile, const Chip8* c8, uint16_t pc, uint16_t op,
+                                 uint64_t start) {
+    uint8_t handler = decode_handler(op, c8->variant);
+    profile->count[handler]++;
+    profile->pc_hits[pc & c8->memory_mask]++;
+
+    if (start) {
+        uint64_t ticks = profile_clock() - start;
+        int bucket = ticks ? 63 - __builtin_clzll(ticks) : 0;
+        profile->latency[handler][bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1]++;
+    }
+
+    if (handler == OP_DXYN) {
+        profile->frame_draws++;
+    } else if (handler == OP_FX0A && c8->PC == pc) {
+        profile->fx0a_spins++;
+    }
+}
+
+static inline void profile_frame(Profile* profile) {
+    uint32_t draws = profile->frame_draws;
+    profile->draws_per_frame[draws < PROFILE_MAX_DRAWS ? draws : PROFILE_MAX_DRAWS]++;
+    profile->frame_draws = 0;
+    profile->frames++;
+}
+
+// Hooks used by emulate_cycle() and tick_timers(). PROFILE_BEGIN reads the
+// opcode itself so it doesn't depend on where the core fetched it from,
+// and only reads the clock for sampled instructions.
+#ifdef CHIP8_PROFILE
+#define PROFILE_BEGIN(c8)                                                                   \
+    uint16_t profile_pc = (c8)->PC;                                                         \
+    uint64_t profile_start = 0;                                                             \
+    if ((c8)->profile) {                                                                    \
+        uint16_t profile_op = (c8)->memory[profile_pc & (c8)->memory_mask] << 8             \
+                              | (c8)->memory[(profile_pc + 1) & (c8)->memory_mask];         \
+        profile_before((c8)->profile, (c8), profile_op);                                    \
+        if ((++(c8)->profile->instructions & (PROFILE_SAMPLE_PERIOD - 1)) == 0) {           \
+            profile_start = profile_clock();                                                \
+        }                                                                                   \
+    }
+#define PROFILE_END(c8, op)                                                                 \
+    do {                                                                                    \
+        if ((c8)->profile) {                                                                \
+            profile_after((c8)->profile, (c8), profile_pc, (op), profile_start);            \
+        }                                                                                   \
+    } while (0)
+#define PROFILE_FRAME(c8)                                                                   \
+    do {                                                                                    \
+        if ((c8)->profile) {                                                                \
+            profile_frame((c8)->profile);                                                   \
+        }                                                                                   \
+    } while (0)
+#else
+#define PROFILE_BEGIN(c8)       ((void)0)
+#define PROFILE_END(c8, op)     ((void)0)
+#define PROFILE_FRAME(c8)       ((void)0)
+#endif
+
+#endif
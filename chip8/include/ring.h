@@ -0,0 +1,106 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Single-producer/single-consumer lock-free ring of fixed-size elements.
+//
+// The producer only ever writes head and the consumer only ever writes tail,
+// so each side needs nothing more than an acquire load of the other side's
+// index and a release store of its own. Both indices count up forever and
+// are masked on access, capacity has to be a power of two. They sit on their
+// own cache lines so the two threads don't fight over one line.
+typedef struct Ring {
+    _Alignas(64) _Atomic size_t head;
+    _Alignas(64) _Atomic size_t tail;
+    _Alignas(64) size_t mask;
+    size_t elem_size;
+    uint8_t* buffer;
+} Ring;
+
+static inline bool ring_init(Ring* ring, size_t capacity, size_t elem_size) {
+    if (capacity == 0 || (capacity & (capacity - 1))) {
+        return false;
+    }
+    ring->buffer = malloc(capacity * elem_size);
+    if (ring->buffer == NULL) {
+        return false;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask = capacity - 1;
+    ring->elem_size = elem_size;
+    return true;
+}
+
+static inline void ring_free(Ring* ring) {
+    free(ring->buffer);
+    ring->buffer = NULL;
+}
+
+// Producer side, returns false without blocking when the ring is full.
+static inline bool ring_push(Ring* ring, const void* elem) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ring->mask) {
+        return false;
+    }
+    memcpy(ring->buffer + (head & ring->mask) * ring->elem_size, elem, ring->elem_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+// Consumer side, copies out up to max elements and returns how many it got.
+static inline size_t ring_pop(Ring* ring, void* out, size_t max) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t count = head - tail;
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy((uint8_t*)out + i * ring->elem_size,
+               ring->buffer + ((tail + i) & ring->mask) * ring->elem_size, ring->elem_size);
+    }
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+// Either side, only a snapshot since the other side keeps moving.
+static inline size_t ring_count(Ring* ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire)
+         - atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+// Blocks until the ring takes elem, for producers that must never drop one.
+// Only waits when the consumer has fallen a whole ring behind.
+void ring_push_wait(Ring* ring, const void* elem);
+
+// Called on a RingWriter's thread with every batch it pops, in order.
+typedef void (*RingDrain)(void* user, const void* batch, size_t count);
+
+// A ring with a background thread draining it, for the trace, movie and
+// capture writers: the producer pushes, the thread hands what it pops to
+// drain() a batch at a time and naps when there's nothing to do, and
+// ring_writer_stop() has drain() see everything pushed before it was called.
+typedef struct RingWriter {
+    Ring ring;
+    pthread_t thread;
+    _Atomic bool stop;
+    RingDrain drain;
+    void* user;
+    void* batch;
+    size_t batch_size;
+    long nap_ns;
+} RingWriter;
+
+bool ring_writer_start(RingWriter* writer, size_t capacity, size_t elem_size, size_t batch_size,
+                       long nap_ns, RingDrain drain, void* user);
+void ring_writer_stop(RingWriter* writer);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef SAVESTATE_H_
+#define SAVESTATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Savestates and rewind.
+//
+// A savestate is the whole machine (memory, registers, stack, timers,
+// display, the FX0A wait, the random generator and the SUPER-CHIP/XO-CHIP
+// extras) as one blob, its size fixed by the variant's memory (4KB, or 64KB
+// for XO-CHIP): the 12 byte SavestateHeader followed by the fields in the
+// order savestate_save() writes them, in host byte order. Anything the host attaches (core, caches,
+// trace) isn't part of it, loading a state invalidates the caches instead.
+// The variant is recorded though, a state only loads into a machine of the
+// same variant.
+//
+// The rewind buffer keeps one delta per pushed frame: the previous
+// snapshot XORed with the new one and run-length encoded, so a frame that
+// only touched a handful of bytes costs a handful of bytes. XOR works both
+// ways, so applying the newest delta to the newest snapshot steps back one
+// frame. When the buffer fills up the oldest deltas get dropped.
+
+#define SAVESTATE_MAGIC     "C8SS"
+#define SAVESTATE_VERSION   4
+
+typedef struct SavestateHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;      // size of the whole blob, header included
+} SavestateHeader;
+
+// the blob for `memory` bytes of memory, and the biggest one there is
+#define SAVESTATE_SIZE(memory)  (sizeof(SavestateHeader) + (memory) + 16 + 2 + 2 + 16 * 2 + 1 \
+                                 + DISPLAY_PLANES * HIRES_HEIGHT * ROW_WORDS * 8 + 1 + 1 + 1 + 1 \
+                                 + 16 + 1 + 1 + 16 + 1 + 1 + 8 + 1)
+#define SAVESTATE_MAX_SIZE      SAVESTATE_SIZE(MEMORY_SIZE)
+
+size_t savestate_size(const Chip8* c8);
+size_t savestate_save(const Chip8* c8, uint8_t* blob);
+bool savestate_load(Chip8* c8, const uint8_t* blob, size_t size);
+bool savestate_write_file(const Chip8* c8, const char* path);
+bool savestate_read_file(Chip8* c8, const char* path);
+
+typedef struct Rewind {
+    // the most recently pushed snapshot, the deltas lead back from it, and
+    // its size (every snapshot is the same size for a machine)
+    uint8_t current[SAVESTATE_MAX_SIZE];
+    size_t size;
+    bool has_current;
+
+    // circular byte buffer of records: length, RLE delta, length again so it
+    // can be walked from either end
+    uint8_t* buffer;
+    size_t capacity;
+    size_t head;        // where the next record starts
+    size_t used;
+    size_t frames;
+
+    uint8_t scratch[SAVESTATE_MAX_SIZE];
+    uint8_t encoded[SAVESTATE_MAX_SIZE * 2];
+} Rewind;
+
+Rewind* rewind_create(size_t capacity);
+void rewind_free(Rewind* rewind);
+void rewind_push(Rewind* rewind, const Chip8* c8);
+bool rewind_pop(Rewind* rewind, Chip8* c8);
+
+#endif
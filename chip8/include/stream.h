@@ -0,0 +1,74 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+#include "frames.h"
+
+// Streaming a machine's display to remote viewers over TCP, and taking their
+// keypads back.
+//
+// The emulator thread only ever copies the finished frame into a triple
+// buffer (see frames.h) and reads back an atomic keypad mask, everything
+// else happens on the stream's own thread: accepting viewers, working out
+// what changed since the last frame sent, and writing it to every viewer
+// through non-blocking sockets. A viewer that can't keep up doesn't slow
+// anyone down, its buffer fills up, it skips the updates that don't fit and
+// gets a keyframe once it has caught up.
+//
+// Every message is a 16 bit length (of what follows it), a type byte and a
+// flags byte: STREAM_HIRES, and a STREAM_PLANE bit for each bitplane the
+// message carries (only planes with something on them or something changed).
+// A row is 1 word in low resolution (the 64x32 screen is 256 bytes) and
+// ROW_WORDS in high resolution, every word is little-endian.
+// - STREAM_KEYFRAME: every row of each plane, sent to a viewer when it
+//   connects or has caught up, to everyone once a second, and whenever the
+//   resolution changes
+// - STREAM_DELTA: for each plane a 64 bit mask of the rows that changed,
+//   then those rows XORed with what they were in the last update. A sprite
+//   drawn in low resolution comes to a few dozen bytes.
+// Viewers send their keypad mask as a 16 bit little-endian word whenever it
+// changes, the machine sees the OR of every viewer's keys. on_keys (when
+// not NULL) gets called from the stream's thread every time that OR
+// changes, so a host parked on FX0A can wake up for it.
+
+#define STREAM_KEYFRAME     'K'
+#define STREAM_DELTA        'D'
+
+#define STREAM_HIRES        1
+#define STREAM_PLANE(p)     (2 << (p))
+
+typedef void (*StreamKeys)(void* user);
+
+typedef struct Stream {
+    Frames frames;
+    _Atomic uint16_t keys;
+    StreamKeys on_keys;
+    void* on_keys_user;
+    _Atomic bool stop;
+    pthread_t thread;
+    int listener;
+
+    // the stream thread's own
+    struct StreamViewer* viewers;
+    int viewer_count;
+    int max_viewers;
+    Frame sent;             // what every up to date viewer has
+    bool has_sent;
+    int since_keyframe;
+} Stream;
+
+Stream* stream_open(uint16_t port, int max_viewers, StreamKeys on_keys, void* user);
+void stream_close(Stream* stream);
+void stream_frame(Stream* stream, const Chip8* c8);
+
+// The OR of every viewer's keypad.
+static inline uint16_t stream_keys(Stream* stream) {
+    return atomic_load_explicit(&stream->keys, memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "ring.h"
+
+// Binary execution trace.
+//
+// emulate_cycle() pushes one fixed-size record per instruction into the
+// instance's ring and a background thread drains it to disk, so the
+// interpreter never formats text or waits on I/O. chip8_trace_decode turns
+// the file back into readable lines.
+//
+// File layout: the 8 byte TraceHeader, then TraceRecords back to back in host
+// byte order until the end of the file.
+
+#define TRACE_MAGIC     "C8TR"
+#define TRACE_VERSION   1
+
+// reg value for instructions that don't write a V register
+#define TRACE_NO_REG    0xFF
+
+typedef struct TraceHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+} TraceHeader;
+
+typedef struct TraceRecord {
+    uint16_t pc;        // address the instruction was fetched from
+    uint16_t opcode;
+    uint16_t i;         // I after the instruction
+    uint8_t reg;        // V register the instruction wrote, or TRACE_NO_REG
+    uint8_t value;      // value of that register afterwards
+} TraceRecord;
+
+typedef struct Trace {
+    RingWriter writer;
+    FILE* file;
+} Trace;
+
+Trace* trace_open(const char* path);
+void trace_close(Trace* trace);
+
+// Only blocks when the writer has fallen a whole ring behind, the trace is
+// meant to be complete so records are never dropped.
+static inline void trace_push(Trace* trace, const TraceRecord* record) {
+    if (!ring_push(&trace->writer.ring, record)) {
+        ring_push_wait(&trace->writer.ring, record);
+    }
+}
+
+// Which V register an opcode writes, for the record's reg/value pair. For
+// the ALU ops that also set VF the record keeps VX, VF can be recovered from
+// the next record that reads it.
+static inline uint8_t trace_written_reg(uint16_t op) {
+    switch (op >> 12) {
+        case 0x6: case 0x7: case 0x8: case 0xC:
+            return (op >> 8) & 0xF;
+        case 0xD:
+            return 0xF;
+        case 0xF:
+            switch (op & 0xFF) {
+                case 0x07: case 0x0A: case 0x65: case 0x85:
+                    return (op >> 8) & 0xF;
+            }
+            break;
+    }
+    return TRACE_NO_REG;
+}
+
+// Hooks used by emulate_cycle(), these compile to nothing unless the build
+// turns on CHIP8_TRACE. TRACE_BEGIN remembers the PC before the instruction
+// runs and TRACE_END emits the record once it has.
+#ifdef CHIP8_TRACE
+#define TRACE_BEGIN(c8)         uint16_t trace_pc = (c8)->PC
+#define TRACE_END(c8, op)                                                       \
+    do {                                                                        \
+        if ((c8)->trace) {                                                      \
+            uint8_t trace_reg = trace_written_reg(op);                          \
+            TraceRecord trace_record = {                                        \
+                trace_pc, (op), (c8)->I, trace_reg,                             \
+                trace_reg == TRACE_NO_REG ? 0 : (c8)->V[trace_reg],             \
+            };                                                                  \
+            trace_push((c8)->trace, &trace_record);                             \
+        }                                                                       \
+    } while (0)
+#else
+#define TRACE_BEGIN(c8)         ((void)0)
+#define TRACE_END(c8, op)       ((void)0)
+#endif
+
+#endif
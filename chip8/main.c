@@ -2,25 +2,101 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <unistd.h>
-#include <errno.h>
-#include <sys/stat.h>
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <signal.h>
 
 #include <SDL.h>
 #include "include/chip8.h"
+#include "include/frontend.h"
+#include "include/fleet.h"
+#include "include/corpus.h"
+#include "include/trace.h"
+#include "include/profile.h"
+#include "include/savestate.h"
+#include "include/audio.h"
+#include "include/frames.h"
+#include "include/movie.h"
+#include "include/stream.h"
+#include "include/debug.h"
+#include "include/presets.h"
+#include "include/governor.h"
+#include "include/capture.h"
 
-int DEBUG = 1;
-
-// Define screen dimensions
-#define SCREEN_WIDTH    64
-#define SCREEN_HEIGHT   32
 #define SDL_SCALING     8
 
-bool should_quit = false;
+_Atomic bool should_quit = false;
 
 SDL_Window* screen;
 SDL_Renderer* renderer;
+SDL_Texture* texture;
+
+// set when the window system lost what we last presented, forces a full redraw
+bool window_exposed = false;
+
+// Keyboard state built up from key events between keypad samples, plus the
+// timestamps (performance counter) of presses to measure key to present
+// latency with. The SDL thread writes the atomics and the emulator thread
+// takes them once per 60Hz tick.
+struct {
+    _Atomic uint16_t held;
+    _Atomic uint16_t latched;
+    _Atomic uint64_t press_time;
+
+    // SDL thread only
+    uint64_t sampled_press;
+    uint64_t latency_total;
+    uint64_t latency_max;
+    uint64_t latency_count;
+
+    // frontend hotkeys: backspace held rewinds, F5/F9 quick save and load,
+    // tab toggles turbo
+    _Atomic bool rewinding;
+    _Atomic bool quicksave;
+    _Atomic bool quickload;
+    _Atomic bool turbo;
+
+    // posted on every key event (and on quit), an emulator thread parked on
+    // FX0A sleeps on it instead of waking up every tick
+    SDL_sem* key_event;
+} input;
+
+// The emulator thread pushes a frame_event when it publishes a frame, unless
+// the last one hasn't been handled yet, so the SDL thread can sleep in
+// SDL_WaitEventTimeout() until there is either input or something to draw.
+Uint32 frame_event;
+_Atomic bool frame_event_pending = false;
+
+#define PIXEL_ON        0xFFFFFFFF
+#define PIXEL_OFF       0xFF000000
+#define ALL_ROWS        (~0ull)
+
+// colour of a pixel by the planes it's lit on, plain CHIP-8 only uses the
+// first two
+uint32_t palette[4] = {PIXEL_OFF, PIXEL_ON, 0xFFFF5500, 0xFF55AAFF};
+
+#define DEFAULT_IPS         960
+#define MAX_CATCH_UP_FRAMES 6
+#define DEFAULT_TURBO       8
+#define SLEEP_SLACK_MS      2
+
+// longest the SDL thread sleeps without an event or a new frame
+#define WAIT_TIMEOUT_MS     100
+
+// default size of the window's rewind buffer, in MB
+#define DEFAULT_REWIND_MB   16
+
+// most frames -A runs ahead, past that the game reacts before it could have
+// seen the key
+#define MAX_RUN_AHEAD       8
+
+// screen pixels per high resolution pixel in a -C capture
+#define CAPTURE_SCALE       4
+
+// viewers one -N stream takes at a time
+#define STREAM_VIEWERS      64
 
 SDL_Scancode keymappings[16] = {
     SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
@@ -29,657 +105,860 @@ SDL_Scancode keymappings[16] = {
     SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V,
 };
 
-// Font:
-uint8_t fontset[80] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0,  // 0
-    0x20, 0x60, 0x20, 0x20, 0x70,  // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0,  // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0,  // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10,  // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0,  // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0,  // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40,  // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0,  // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0,  // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90,  // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0,  // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0,  // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0,  // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0,  // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80   // F
-};
+// Called after every present, closes out the press waiting on it.
+static void input_presented(void) {
+    if (!input.sampled_press) {
+        return;
+    }
+    uint64_t latency = SDL_GetPerformanceCounter() - input.sampled_press;
+    input.latency_total += latency;
+    if (latency > input.latency_max) {
+        input.latency_max = latency;
+    }
+    input.latency_count++;
+    input.sampled_press = 0;
+}
 
-// Memory implementation: 
-// Total space is 4kb or 4096bytes;
-//
-// Then 0x000 - 0x1FF is space for the interpreter in most chip8 roms;
-// 0x200 - 0xFFF is the program and data space
-//
-// Keep in mind that opcodes are big-endian while macs use little-endian 
-//
-// The following structures are being implemented as described in the specs
-// section of Tobias Langhoff's CHIP-8 Guide.
+void init_sdl_display(bool vsync) {
 
-// Memory
-uint8_t memory[4096] = {0};
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+    screen = SDL_CreateWindow("CHIP-8", SDL_WINDOWPOS_CENTERED,
+                             SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH * SDL_SCALING, 
+                             SCREEN_HEIGHT * SDL_SCALING, 0);
+    renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
 
-// Registers, CHIP-8 used 16 general purpose 8-bit registers, referred to 
-// as VX where X is a hexadecimal digit, so V0-VF but ours will be stored in 
-// an array and can be indexed after, use unsigned chars since they're 8-bits
-uint8_t V[16] = {0};
+    // The display lives in a texture the size of the high resolution screen,
+    // low resolution only uses its top-left quarter. The GPU does the upscale
+    // when it gets copied to the window. Nearest filtering keeps the pixels
+    // square.
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                HIRES_WIDTH, HIRES_HEIGHT);
 
-// Special 16-bit register 'I' that is the index register which points at
-// locations in memory, use short since that is 16-bits
-uint16_t I = 0;
+}
 
-// The program counter 'PC' which points at the current instruction that is in memory
-// reminder that in memory that program space starts at 0x200
-uint16_t PC = 0x200;
+// Upload the rows of the display that changed since the last frame into the
+// texture and present it with a single copy. When nothing changed (and the
+// window doesn't need repainting) this does nothing at all, not even a present.
+void draw_on_screen(const uint64_t* display, bool hires, uint64_t dirty_rows) {
 
-// The stack, an array of 16-bit addresses, most original interpreters apparently
-// had very limited space, with some limiting it to 2 addresses even, here I'll
-// take a very excessive implementation of eight 16-bit addresses.
-uint16_t stack[16] = {0};
+    int width = hires ? HIRES_WIDTH : SCREEN_WIDTH;
+    int height = hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
 
-// points to the top of the stack so to speak.
-uint8_t stack_idx = 0;
+    if (window_exposed) {
+        dirty_rows = ALL_ROWS;
+        window_exposed = false;
+    }
 
-// the keypad:
-uint8_t keypad[16] = {0};
+    if (height < 64) {
+        dirty_rows &= (1ull << height) - 1;
+    }
+    if (dirty_rows == 0) {
+        return;
+    }
 
-// display of height 64, and width of 32, stored in a 1D array
-uint8_t display[SCREEN_WIDTH * SCREEN_HEIGHT] = {0};
+    // Lock the span from the first to the last changed row, locked pixels are
+    // write-only so every row in the span gets rewritten, changed or not.
+    int first = 0;
+    while (!(dirty_rows & (1ull << first))) {
+        first++;
+    }
+    int last = height - 1;
+    while (!(dirty_rows & (1ull << last))) {
+        last--;
+    }
 
-// delay timer
-uint8_t delay_timer = 0;
+    SDL_Rect rows = {0, first, width, last - first + 1};
+    void* pixels;
+    int pitch;
 
-// sound timer
-uint8_t sound_timer = 0;
+    if (SDL_LockTexture(texture, &rows, &pixels, &pitch) == 0) {
+        for (int y = first; y <= last; y++) {
+            uint32_t* row = (uint32_t*)((uint8_t*)pixels + (y - first) * pitch);
+            for (int x = 0; x < width; x++) {
+                row[x] = palette[display_color(display, x, y)];
+            }
+        }
+        SDL_UnlockTexture(texture);
+    }
 
-// additional flag defined to make updating display simpler
-// display flag
-uint8_t draw_flag = 0;
-uint8_t sound_flag = 0;
+    SDL_Rect screen_area = {0, 0, width, height};
+    SDL_RenderCopy(renderer, texture, &screen_area, NULL);
+    SDL_RenderPresent(renderer);
+    input_presented();
 
-bool key_found = false;
-uint8_t key_pressed = 255;
+}
 
-//////////////////////////////////
-// CHIP-8 Functionality:        //
-//////////////////////////////////
+// CHIP-8 key for a scancode, or -1 when it isn't mapped.
+static int chip8_key(SDL_Scancode scancode) {
+    for (int key = 0; key < 16; key++) {
+        if (keymappings[key] == scancode) {
+            return key;
+        }
+    }
+    return -1;
+}
 
-void init_cpu(void) {
+static void resync_held_keys(void) {
+    const Uint8* state = SDL_GetKeyboardState(NULL);
+    uint16_t held = 0;
+    for (int key = 0; key < 16; key++) {
+        if (state[keymappings[key]]) {
+            held |= 1u << key;
+        }
+    }
+    atomic_store(&input.held, held);
+}
 
-    // Set a seed for the random functions in the rest of the interpreter.
-    srand((unsigned int)time(NULL));
+// Keys from stream viewers, called on the stream's thread.
+static void post_key_event(void* sem) {
+    SDL_SemPost(sem);
+}
 
-    // load the fontset into memory
-    memcpy(memory, fontset, sizeof(fontset));
+// Key state is kept from the key events themselves, so nothing queued behind
+// mouse or window events can delay it, and a key that goes down and up again
+// before the next sample still counts as pressed for one tick (FX0A needs to
+// see both the press and the release).
+static void handle_event(const SDL_Event* event) {
+
+    switch (event->type) {
+        case SDL_QUIT:
+            should_quit = 1;
+            SDL_SemPost(input.key_event);
+            break;
+        case SDL_WINDOWEVENT:
+            // focus changes can swallow key ups, take the state from SDL
+            window_exposed = true;
+            resync_held_keys();
+            SDL_SemPost(input.key_event);
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            SDL_SemPost(input.key_event);
+            if (event->key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
+                should_quit = 1;
+                break;
+            }
+            if (event->key.keysym.scancode == SDL_SCANCODE_BACKSPACE) {
+                atomic_store(&input.rewinding, event->type == SDL_KEYDOWN);
+                break;
+            }
+            if (event->type == SDL_KEYDOWN && !event->key.repeat) {
+                if (event->key.keysym.scancode == SDL_SCANCODE_F5) {
+                    atomic_store(&input.quicksave, true);
+                } else if (event->key.keysym.scancode == SDL_SCANCODE_F9) {
+                    atomic_store(&input.quickload, true);
+                } else if (event->key.keysym.scancode == SDL_SCANCODE_TAB) {
+                    atomic_store(&input.turbo, !atomic_load(&input.turbo));
+                }
+#ifdef CHIP8_PROFILE
+                if (event->key.keysym.scancode == SDL_SCANCODE_F12) {
+                    profile_requested = 1;
+                }
+#endif
+            }
+            int key = chip8_key(event->key.keysym.scancode);
+            if (key < 0 || event->key.repeat) {
+                break;
+            }
+            if (event->type == SDL_KEYDOWN) {
+                atomic_fetch_or(&input.held, 1u << key);
+                // only the first press since the last sample gets timed
+                uint64_t none = 0;
+                atomic_compare_exchange_strong(&input.press_time, &none, SDL_GetPerformanceCounter());
+                atomic_fetch_or(&input.latched, 1u << key);
+            } else {
+                atomic_fetch_and(&input.held, (uint16_t)~(1u << key));
+            }
+            break;
+        }
+        default:
+            if (event->type == frame_event) {
+                atomic_store(&frame_event_pending, false);
+            }
+            break;
+    }
 
 }
 
-int load_rom(char* filename) {
+// Drain every pending event.
+void sdl_handler(void) {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        handle_event(&event);
+    }
+}
 
-    FILE* fp = fopen(filename, "rb");
+// The keypad to hand the machine, once per 60Hz tick on the emulator thread.
+// The press timestamp is left for the caller to put in the frame it publishes
+// next, its latency ends at the present that frame shows up in.
+uint16_t sample_keypad(uint64_t* press_time) {
+    uint16_t down = atomic_load(&input.held) | atomic_exchange(&input.latched, 0);
+    *press_time = atomic_exchange(&input.press_time, 0);
+    return down;
+}
 
-    if (fp == NULL) return errno;
+void print_input_latency(void) {
+    if (input.latency_count == 0) {
+        return;
+    }
+    double ms = 1000.0 / SDL_GetPerformanceFrequency();
+    printf("[OK] key to present latency over %llu presses: avg %.2fms, max %.2fms\n",
+           (unsigned long long)input.latency_count,
+           input.latency_total * ms / input.latency_count, input.latency_max * ms);
+}
 
-    struct stat file_stat;
-    stat(filename, &file_stat);
-    size_t file_size = file_stat.st_size;
+void stop_display(void) {
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(screen);
+    SDL_Quit();
+}
 
-    size_t bytes_read = fread(memory + 0x200, 1, sizeof(memory) - 0x200, fp);
+void usage(void) {
+    error("Usage: emulator [-H] [-n instructions] [-f frames] [-j threads] [-i instances] [-b] [-c core] [-X variant] [-Q quirks] [-t file] [-P file] [-s ips] [-T speed] [-V] [-L file] [-S file] [-r MB] [-R seed] [-M file] [-p file] [-N port] [-D] [-A frames] [-I file] [-C file] [-m] rom.ch8 [rom.ch8 ...]\n"
+          "  -H               run headless (no SDL window), as fast as possible\n"
+          "  -n instructions  stop a headless run after this many instructions\n"
+          "  -f frames        stop a headless run after this many 60Hz frames\n"
+          "  -j threads       headless fleet run, spread instances over this many threads\n"
+          "  -i instances     headless fleet run, total machines to run over the given roms\n"
+          "                   (roms can also be directories or chip8_pack corpus files)\n"
+          "  -b               headless fleet run, instances of the same rom run in lockstep\n"
+          "                   batches of 32 with their registers side by side (SIMD)\n"
+          "  -c core          interpreter core: switch (default), predecoded or block\n"
+          "  -X variant       chip8, schip or xochip (default: .sc8 and .xo8 roms are\n"
+          "                   SUPER-CHIP and XO-CHIP, anything else CHIP-8)\n"
+          "  -Q quirks        quirk profile: vip, chip48, schip or xochip (default: the\n"
+          "                   variant's, vip for CHIP-8)\n"
+          "  -t file          write a binary instruction trace (needs a CHIP8_TRACE build)\n"
+          "  -P file          profile the run, snapshots go to file on SIGUSR1, F12 and exit\n"
+          "                   (- for stdout, needs a CHIP8_PROFILE build)\n"
+          "  -s ips           instructions per second to run in the window (default 960)\n"
+          "  -T speed         start in turbo, this many times real time or 0 for as fast as\n"
+          "                   possible (default 8 when tab turns it on)\n"
+          "  -V               present with vsync\n"
+          "  -L file          start from a savestate instead of from reset\n"
+          "  -S file          write a savestate when the run ends (F5 in the window writes it too)\n"
+          "  -r MB            size of the window's rewind buffer, 0 turns rewind off (default 16)\n"
+          "  -R seed          seed for CXNN's random numbers (default: the current time)\n"
+          "  -M file          record the window's input to a movie (turns rewind and F9 off)\n"
+          "  -p file          play a movie back headless, with the rom it was recorded on\n"
+          "  -N port          stream the display to TCP viewers on port and take their keys,\n"
+          "                   a headless run with it runs in real time\n"
+          "  -D               debug from a command console on stdin instead of running,\n"
+          "                   headless (type h for its commands)\n"
+          "  -A frames        run ahead this many frames with the current keys and show the\n"
+          "                   last one, hides the rom's own input lag (default 0, off)\n"
+          "  -I file          per-rom speed presets by rom hash, used unless -s is given\n"
+          "  -C file          capture the display to an animated GIF, written in the background\n"
+          "  -m               mute, don't open an audio device\n");
+}
 
-    fclose(fp);
+// Performance counter ticks from the start of a run of frames to the end of
+// its frame n, frames going by at rate a second.
+static uint64_t frame_deadline(uint64_t frame, uint64_t freq, uint64_t rate) {
+    return frame / rate * freq + frame % rate * freq / rate;
+}
 
-    if (bytes_read != file_size) {
-        // ensure that the entire rom is loaded in, if not early return to error out
-        return -1;
+// Sleep until the performance counter reaches deadline. SDL_Delay only has
+// millisecond granularity and tends to oversleep, so it covers all but the
+// last couple of milliseconds and the rest is spent yielding.
+static void sleep_until(uint64_t deadline, uint64_t freq) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    while (now < deadline) {
+        uint64_t ms = (deadline - now) * 1000 / freq;
+        if (ms > SLEEP_SLACK_MS) {
+            SDL_Delay((uint32_t)(ms - SLEEP_SLACK_MS));
+        } else {
+            SDL_Delay(0);
+        }
+        now = SDL_GetPerformanceCounter();
     }
+}
 
-    return 0;
+#ifdef CHIP8_PROFILE
+// Append a snapshot of the profile to path, "-" is stdout.
+static void write_profile(const Profile* profile, const char* path) {
+    if (strcmp(path, "-") == 0) {
+        profile_write(profile, stdout);
+        return;
+    }
+    FILE* out = fopen(path, "a");
+    if (out == NULL) {
+        perror("Error while writing profile");
+        return;
+    }
+    profile_write(profile, out);
+    fclose(out);
+}
 
+// Write a snapshot if one was asked for since the last call.
+static void poll_profile(const Profile* profile, const char* path) {
+    if (profile && profile_requested) {
+        profile_requested = 0;
+        write_profile(profile, path);
+    }
+}
+#endif
+
+// What the emulator thread shares with the SDL thread. The machine belongs
+// to the emulator thread until it gets joined.
+typedef struct Emulation {
+    Chip8* c8;
+    Frames frames;
+    Audio* audio;
+    Rewind* rewind;
+    MovieWriter* movie;
+    Stream* stream;
+    // scratch machine the frames run ahead on, NULL without -A
+    Chip8* ahead;
+    int run_ahead;
+    // steps presentation down when the host gets busy, see governor.h
+    Governor governor;
+    uint64_t ips;
+    // turbo's multiple of real time, 0 runs flat out
+    uint64_t turbo;
+    const char* save_path;
+    const char* profile_path;
+} Emulation;
+
+// Run-ahead: copy the machine into a scratch one and run it `frames` more
+// frames with the keys it has now, from frame on. What the window shows is
+// where the game will be once it has reacted to the keys, so a rom that
+// takes a frame or three to act on a press appears to act at once. The real
+// machine never runs anything twice, the copy is thrown away next frame.
+// The copy never fails, the scratch machine was sized for the rom's variant.
+static const Chip8* run_ahead(Chip8* ahead, const Chip8* c8, uint64_t frame, uint64_t ips, int frames) {
+    chip8_copy(ahead, c8);
+    for (int i = 0; i < frames; i++) {
+        uint64_t budget = frame_instructions(frame + i, ips);
+        run_instructions(ahead, budget > INT32_MAX ? INT32_MAX : (int)budget);
+        ahead->draw_flag = 0;
+        tick_timers(ahead);
+    }
+    return ahead;
 }
 
-//////////////////////////////////
-// SDL HANDLING CODE GOES HERE: //
-//////////////////////////////////
+// The window's emulator thread, fixed timestep on the performance counter:
+// frame n is due at start + n * freq / 60, computed from the frame number
+// rather than by adding up periods so it never drifts. Each due frame runs
+// its share of the instructions-per-second target (the share is also worked
+// out from the totals, so 700 ips really is 700 and not 60 * 11) and ticks
+// the timers exactly once. The newest frame goes out through the triple
+// buffer, presenting never holds this loop up.
+//
+// Turbo only changes the clock the frames are due on, 60 * speed a second or
+// no clock at all, every frame still runs its share and ticks the timers once,
+// so the rom sees exactly the run it would in real time. Only every speed-th
+// frame gets published (about 60 a second when flat out) and turbo frames
+// are silent. Whenever the clock changes, or after a stall, pacing starts
+// over from the current time and frame.
+//
+// With run-ahead the published frame comes from run_ahead() instead, except
+// in turbo and while rewinding, where nobody is waiting on a reaction. In
+// real time the governor drops run-ahead and then frames to draw before the
+// loop would fall behind, see governor.h.
+static int emulate(void* data) {
 
-void init_sdl_display(void) {
+    Emulation* emu = data;
+    Chip8* c8 = emu->c8;
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint64_t frame = 0;
+    uint64_t press_time = 0;
 
-    SDL_Init(SDL_INIT_VIDEO);
-    screen = SDL_CreateWindow("CHIP-8", SDL_WINDOWPOS_CENTERED,
-                             SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH * SDL_SCALING, 
-                             SCREEN_HEIGHT * SDL_SCALING, 0);
-    renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED);
+    // frames are due on a clock counting from start at first_frame
+    uint64_t first_frame = 0;
+    uint64_t speed = 1;
+    uint64_t published = 0;
 
-}
+    uint8_t quickslot[SAVESTATE_MAX_SIZE];
+    bool quickslot_used = false;
 
-void draw_on_screen(unsigned char* display) {
+    // the last frame run left the machine idle in FX0A
+    bool key_wait = false;
 
-    // TODO: Fix going offscreen behaviour
+    governor_init(&emu->governor, freq, start);
 
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); 
+    while (!should_quit) {
+        uint64_t now = SDL_GetPerformanceCounter();
+        uint64_t busy_from = now;
+        uint64_t caught_up = 0;
+        uint64_t dropped = 0;
+
+        uint64_t want = atomic_load(&input.turbo) ? emu->turbo : 1;
+        if (want != speed) {
+            speed = want;
+            start = now;
+            first_frame = frame;
+            governor_restart(&emu->governor, now);
+        }
+        uint64_t rate = FRAME_RATE * speed;
+
+        // flat out there's no deadline, run for a 60th of a second at a time
+        while (!should_quit && (speed ? now >= start + frame_deadline(frame + 1 - first_frame, freq, rate)
+                                      : now < start + freq / FRAME_RATE)) {
+            // after a long stall (suspend, a debugger) don't try to run all
+            // the missed frames back to back, drop them and carry on
+            if (speed && caught_up == MAX_CATCH_UP_FRAMES * speed) {
+                uint64_t due = (now - start) * rate / freq;
+                dropped = due > frame - first_frame ? due - (frame - first_frame) : 0;
+                start = now;
+                first_frame = frame;
+                break;
+            }
 
-    SDL_RenderClear(renderer);
+            if (atomic_exchange(&input.quicksave, false)) {
+                savestate_save(c8, quickslot);
+                quickslot_used = true;
+                if (emu->save_path && !savestate_write_file(c8, emu->save_path)) {
+                    perror("Error while writing savestate");
+                }
+            }
+            // a movie can't go back in time, loading is off while recording
+            if (atomic_exchange(&input.quickload, false) && quickslot_used && !emu->movie) {
+                savestate_load(c8, quickslot, sizeof(quickslot));
+            }
 
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+            if (emu->rewind && atomic_load(&input.rewinding)) {
+                rewind_pop(emu->rewind, c8);
+                audio_frame(emu->audio, frame, false, NULL, 0);
+                key_wait = false;
+            } else {
+                uint64_t press;
+                uint16_t keys = sample_keypad(&press);
+                if (emu->stream) {
+                    keys |= stream_keys(emu->stream);
+                }
+                if (emu->movie) {
+                    movie_frame(emu->movie, keys);
+                }
+                chip8_set_keys(c8, keys);
+                if (!press_time) {
+                    press_time = press;
+                }
+                uint64_t budget = frame_instructions(frame, emu->ips);
+                int ran = run_instructions(c8, budget > INT32_MAX ? INT32_MAX : (int)budget);
+                if (speed == 1) {
+                    governor_frame(&emu->governor, budget, ran);
+                }
+                key_wait = c8->idle == IDLE_KEY;
+                c8->draw_flag = 0;
+                audio_frame(emu->audio, frame, c8->sound_timer > 0 && speed == 1,
+                            c8->has_pattern ? c8->pattern : NULL, c8->pitch);
+                tick_timers(c8);
+                if (emu->rewind) {
+                    rewind_push(emu->rewind, c8);
+                }
+            }
 
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            if (display[x + (y * SCREEN_WIDTH)]) {
-                SDL_Rect rect;
+            frame++;
+            caught_up++;
+            if (!speed) {
+                now = SDL_GetPerformanceCounter();
+            }
+        }
+        if (!speed) {
+            start = now;
+        }
 
-                rect.x = x * SDL_SCALING;
-                rect.y = y * SDL_SCALING;
-                rect.w = SDL_SCALING;
-                rect.h = SDL_SCALING;
+#ifdef CHIP8_PROFILE
+        poll_profile(c8->profile, emu->profile_path);
+#endif
+
+        // a press that only made it into a frame the window skipped moves
+        // on to this one
+        uint64_t every = speed == 1 ? governor_publish_every(&emu->governor) : speed;
+        if (caught_up && (!speed || frame - published >= every)) {
+            published = frame;
+            const Chip8* shown = c8;
+            if (emu->ahead && speed == 1 && governor_run_ahead(&emu->governor)
+                    && !(emu->rewind && atomic_load(&input.rewinding))) {
+                shown = run_ahead(emu->ahead, c8, frame, emu->ips, emu->run_ahead);
+            }
+            Frame* back = frames_back(&emu->frames);
+            memcpy(back->display, chip8_framebuffer(shown), sizeof(back->display));
+            back->hires = shown->hires;
+            back->press_time = press_time;
+            press_time = frames_publish(&emu->frames) ? frames_back(&emu->frames)->press_time : 0;
+            if (emu->stream) {
+                stream_frame(emu->stream, shown);
+            }
 
-                SDL_RenderFillRect(renderer, &rect);
+            if (!atomic_exchange(&frame_event_pending, true)) {
+                SDL_Event event = {.type = frame_event};
+                SDL_PushEvent(&event);
+            }
+        }
 
+        // every frame after the first of a pass ran behind its deadline,
+        // turbo frames have no deadline and aren't counted at all
+        if (speed == 1) {
+            governor_pass(&emu->governor, SDL_GetPerformanceCounter() - busy_from,
+                          caught_up > 1 ? caught_up - 1 : 0, dropped);
+            governor_update(&emu->governor, SDL_GetPerformanceCounter());
+        }
+
+        // Parked in FX0A with both timers run down, no frame can change a
+        // thing until a key does. Block until the SDL thread sees a key event
+        // instead of waking up every tick, then go on from now rather than
+        // catching up on frames that would have done nothing. Every key and
+        // window event posts whether anything is parked or not, so drop what
+        // piled up while the rom ran first, a key that lands between the last
+        // frame and the drain only costs the timeout.
+        if (key_wait && input.key_event && !c8->delay_timer && !c8->sound_timer) {
+            while (SDL_SemTryWait(input.key_event) == 0) {
+            }
+            if (SDL_SemWaitTimeout(input.key_event, WAIT_TIMEOUT_MS) == 0) {
+                key_wait = false;
             }
+            start = SDL_GetPerformanceCounter();
+            first_frame = frame;
+            continue;
+        }
+
+        if (speed) {
+            sleep_until(start + frame_deadline(frame + 1 - first_frame, freq, rate), freq);
         }
     }
 
-    SDL_RenderPresent(renderer);
+    return 0;
 
 }
 
-void sdl_handler(unsigned char* keypad) {
-    
-    SDL_Event event;
+static void stop_running(int signal) {
+    (void)signal;
+    should_quit = 1;
+}
 
-    if (SDL_PollEvent(&event)) {
-        const Uint8* state = SDL_GetKeyboardState(NULL);
+// A headless run with a stream: the frames the window would run, with the
+// viewers' keys, on the same clock (CLOCK_MONOTONIC instead of SDL's counter)
+// until a limit is hit or SIGINT/SIGTERM. Returns the number of instructions
+// executed, frames_run gets the frame count.
+static uint64_t run_streamed(Chip8* c8, Stream* stream, uint64_t ips, uint64_t max_instructions,
+                             uint64_t max_frames, uint64_t* frames_run) {
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t instructions = 0;
+    uint64_t frame = 0;
+
+    while (!should_quit && instructions < max_instructions && frame < max_frames) {
+        chip8_set_keys(c8, stream_keys(stream));
+        uint64_t budget = frame_instructions(frame, ips);
+        if (budget > max_instructions - instructions) {
+            budget = max_instructions - instructions;
+        }
+        instructions += run_instructions(c8, budget > INT32_MAX ? INT32_MAX : (int)budget);
+        c8->draw_flag = 0;
+        tick_timers(c8);
+        stream_frame(stream, c8);
+        frame++;
+
+        uint64_t ns = start.tv_nsec + frame_deadline(frame, 1000000000ull, FRAME_RATE);
+        struct timespec due = {start.tv_sec + (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull)};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+    }
 
-        switch (event.type) {
-            case SDL_QUIT:
-                should_quit = 1;
+    *frames_run = frame;
+    return instructions;
+
+}
+
+int main(int argc, char** argv) {
+
+    bool headless = false;
+    uint64_t max_instructions = UINT64_MAX;
+    uint64_t max_frames = UINT64_MAX;
+    int threads = 0;
+    int instances = 0;
+    bool batch = false;
+    char* trace_path = NULL;
+    char* profile_path = NULL;
+    Chip8Core core = CORE_SWITCH;
+    int variant = -1;       // from the rom's extension unless -X says
+    int quirks = -1;        // the variant's profile unless -Q says
+    uint64_t ips = DEFAULT_IPS;
+    int turbo = -1;         // off until tab unless -T says
+    bool vsync = false;
+    char* save_path = NULL;
+    char* load_path = NULL;
+    size_t rewind_mb = DEFAULT_REWIND_MB;
+    uint64_t seed = (uint64_t)time(NULL);
+    bool mute = false;
+    char* record_path = NULL;
+    char* play_path = NULL;
+    int port = -1;
+    bool debugging = false;
+    int ahead_frames = 0;
+    bool ips_given = false;
+    char* presets_path = NULL;
+    char* capture_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Hn:f:j:i:bt:P:c:X:Q:s:T:VS:L:r:R:M:p:N:DA:I:C:m")) != -1) {
+        switch (opt) {
+            case 'H':
+                headless = true;
+                break;
+            case 'n':
+                max_instructions = strtoull(optarg, NULL, 10);
+                break;
+            case 'f':
+                max_frames = strtoull(optarg, NULL, 10);
                 break;
-            default: 
-                if (state[SDL_SCANCODE_ESCAPE]) {
-                    should_quit = 1;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'i':
+                instances = atoi(optarg);
+                break;
+            case 'b':
+                batch = true;
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            case 'P':
+                profile_path = optarg;
+                break;
+            case 's':
+                ips = strtoull(optarg, NULL, 10);
+                if (ips == 0) {
+                    error("[FAILED] -s needs a positive instructions per second target\n");
+                    return 1;
+                }
+                ips_given = true;
+                break;
+            case 'I':
+                presets_path = optarg;
+                break;
+            case 'C':
+                capture_path = optarg;
+                break;
+            case 'T':
+                turbo = atoi(optarg);
+                if (turbo < 0) {
+                    error("[FAILED] -T needs a multiple of real time, or 0 for no limit\n");
+                    return 1;
+                }
+                break;
+            case 'V':
+                vsync = true;
+                break;
+            case 'S':
+                save_path = optarg;
+                break;
+            case 'L':
+                load_path = optarg;
+                break;
+            case 'r':
+                rewind_mb = strtoull(optarg, NULL, 10);
+                break;
+            case 'R':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'M':
+                record_path = optarg;
+                break;
+            case 'p':
+                play_path = optarg;
+                headless = true;
+                break;
+            case 'N':
+                port = atoi(optarg);
+                if (port <= 0 || port > 65535) {
+                    error("[FAILED] -N needs a TCP port\n");
+                    return 1;
+                }
+                break;
+            case 'D':
+                debugging = true;
+                headless = true;
+                break;
+            case 'A':
+                ahead_frames = atoi(optarg);
+                if (ahead_frames < 0 || ahead_frames > MAX_RUN_AHEAD) {
+                    error("[FAILED] -A runs ahead 0 to %d frames\n", MAX_RUN_AHEAD);
+                    return 1;
+                }
+                break;
+            case 'm':
+                mute = true;
+                break;
+            case 'c':
+                if (!parse_core(optarg, &core)) {
+                    error("[FAILED] unknown core %s\n", optarg);
+                    return 1;
                 }
-                for (int keycode = 0; keycode < 16; keycode++) {
-                    keypad[keycode] = state[keymappings[keycode]];
+                break;
+            case 'X': {
+                Chip8Variant parsed;
+                if (!parse_variant(optarg, &parsed)) {
+                    error("[FAILED] unknown variant %s\n", optarg);
+                    return 1;
                 }
+                variant = parsed;
                 break;
+            }
+            case 'Q': {
+                Chip8Quirks parsed;
+                if (!parse_quirks(optarg, &parsed)) {
+                    error("[FAILED] unknown quirk profile %s\n", optarg);
+                    return 1;
+                }
+                quirks = parsed;
+                break;
+            }
+            default:
+                usage();
+                return 1;
         }
     }
-}
 
-void stop_display(void) {
-    SDL_DestroyWindow(screen);
-    SDL_Quit();
-}
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
 
-///////////////////////////////
-// CHIP-8 'EMULATOR'         //
-///////////////////////////////
-
-// This is the function that will modify and use the emulated structures of a chip-8
-// system. This will be what fetches, decodes, and executes opcodes from the roms
-// controlling the emulated system.
-bool emulate_cycle(void) {
-
-    uint16_t op = memory[PC] << 8 | memory[PC + 1];
-    printf("opcode: %X\n", op);
-    int opcode_type = (op & 0xF000) >> 12;
-
-    int op_nibbles = op & 0x0FFF;
-
-    // grab 'nibbles' from the instruction opcode, 
-    // first nibble is what specifies the instruction type
-    // X: second nibble is for grabbing of the 16 registers, VX from V0-VF;
-    // Y: third nibble is also for grabbing a register VY, from V0-VF;
-    // N: 4th nibble a 4-bit number
-    // NN: second byte (3rd and 4th nibbles), an 8-bit immediate number
-    // NNN: 2nd, 3rd, 4th nibbles, 12-bit immediate mem address.
-
-    uint8_t X = (op & 0x0F00) >> 8;
-    uint8_t Y = (op & 0x00F0) >> 4;
-
-    printf("opcode_type: %X, op_nibbles: X: %X, Y: %X\n", opcode_type, X, Y);
-
-    switch (opcode_type) {
-        case 0x0: // First digit is a zero: 
-            switch(op_nibbles) {
-                case 0x0E0: // combined the opcode is 0x00E0 which clears the screen
-                    printf("[OK] 0x%X: 00E0\n", op);
-                    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
-                        display[i] = 0;
-                    }
-                    PC += 2;
-                    break;
-                case 0x0EE: // Return from subroutine setting PC to address at top of 
-                    // stack, then subtracting one from the stack pointer.
-                    printf("[OK] 0x%X: 00EE\n", op); // Prints op just as EE rather than 00EE
-                    // why does this not print as expected??
-                    // Get top of stack
-                    PC = stack[stack_idx];
-                    stack_idx--;
-                    PC += 2;
-                    break;
-                // Remaining cases for 0x0NNN are made to jump to a machine code routine
-                // at NNN, according to one of the guides I'm following, this instruction
-                // does not get implemented in modern interpreters.
-                default:
-                    printf("[ERROR] these instructions shouldn't be getting called, %X\n", op);
-                    break;
-            }
-            break;
-        case 0x1:
-            // For this case of 0x1NNN, it is a jump to location NNN, ie setting the PC
-            // to NNN.
-            printf("[OK] 0x%X: 1NNN\n", op);
-            PC = op_nibbles;
-            break;
-        case 0x2:
-            // 0x2NNN - Call subroutine at NNN, interpreter increments the stack pointer,
-            // and puts the current PC on the top of the stack, the PC is then set to NNN
-            printf("[OK] 0x%X: 2NNN\n", op);
-            stack_idx++;
-            stack[stack_idx] = PC;
-            PC = op_nibbles;
-            printf("PC: 0x%X; stack_idx: %d; value @ stack_idx: 0x%X\n", PC, stack_idx, stack[stack_idx]);
-            break;
-        case 0x3:
-            // 0x3XNN, skips the next instruction if VX = NN;
-            printf("[OK] 0x%X: 3NNN\n", op);
-            if (V[X] == (op_nibbles & 0x0FF)) {
-                PC += 2;
-            }
-            PC += 2;
-            break;
-        case 0x4:
-            // 0x4XNN, skips the instruction if VX != NN;
-            printf("[OK] 0x%X: 4NNN\n", op);
-            if (V[X] !=  (op_nibbles & 0x0FF)) {
-                PC += 2;
-            }
-            PC += 2;
-            break;
-        case 0x5:
-            // 0x5XY0, skip the next instruction if VX = VY
-            printf("[OK] 0x%X: 5XY0\n", op);
-            if (V[X] == V[Y]) {
-                PC += 2;
-            }
-            PC += 2;
-            break;
-        case 0x6:
-            // 0x6XNN, sets V[X] to NN
-            printf("[OK] 0x%X: 6NNN\n", op);
-            V[X] = (op_nibbles & 0x0FF);
-            PC += 2;
-            break;
-        case 0x7:
-            printf("[OK] 0x%X: 7NNN\n", op);
-            // 0x7XNN, sets VX to value at VX + NN;
-            V[X] += (op_nibbles & 0x0FF);
-            PC += 2;
-            break;
-        case 0x8:
-            // 0x8XYZ, last nibble has different operators so break this 
-            // section down some more with a sub switch statement.
-            switch (op_nibbles & 0x00F) {
-                case 0x0:
-                    // 0x8XY0: Set VX to VY 
-                    printf("[OK] 0x%X: 8XY0\n", op);
-                    V[X] = V[Y];
-                    PC += 2;
-                    break;
-                case 0x1:
-                    // 0x8XY1: set VX to VX OR VY; do bitwise OR on the registers
-                    printf("[OK] 0x%X: 8XY1\n", op);
-                    V[X] = V[X] | V[Y];
-                    V[15] = 0;
-                    PC += 2;
-                    break;
-                case 0x2:
-                    // 0x8XY2: set VX to VX AND VY; do bitwise AND;
-                    printf("[OK] 0x%X: 8XY2\n", op);
-                    V[X] = V[X] & V[Y];
-                    V[15] = 0;
-                    PC += 2;
-                    break;
-                case 0x3:
-                    // 0x8XY3: set VX to VX XOR VY; do bitwise XOR;
-                    printf("[OK] 0x%X: 8XY3\n", op);
-                    V[X] = V[X] ^ V[Y];
-                    V[15] = 0;
-                    PC += 2;
-                    break;
-                case 0x4: { // Include the braces to be able to define reg_sum
-                    // 0x8XY4: set VX to VX + VY; use VF as carry if result is more than 255;
-                    // VF set to 1 in that case, otherwise 0 and only lowest 8 bits are 
-                    // kept and stored in VX;
-                    printf("[OK] 0x%X: 8XY4\n", op);
-                    uint16_t sum = V[X] + V[Y];
-                    if (sum > 255) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
-                    }
-                    // Do bitwise and to keep the lower 8 bits
-                    V[X] = sum & 0xFF;
-
-                    if (X == 0xF) {
-                        if (sum > 255) {
-                            V[0xF] = 1;
-                        } else {
-                            V[0xF] = 0;
-                        }
-                    }
+    int rom_count = argc - optind;
+    bool fleet = threads > 0 || instances > 0 || batch || rom_count > 1 || corpus_is_bundle(argv[optind]);
 
-                    PC += 2;
-                    break;
-                }
-                case 0x5: 
-                    // 0x8XY5: Set VX to VX - VY, VF set to NOT Borrow;
-                    // if VX > VY then VF = 1, 0 otherwise;
-                    printf("[OK] 0x%X: 8XY5\n", op);
-                    uint8_t diff = V[X] - V[Y];
-
-                    if (V[X] >= V[Y]) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
-                    }
+    if (fleet && !headless) {
+        error("[FAILED] -j, -i, -b and multiple roms are only supported together with -H\n");
+        return 1;
+    }
 
-                    if (X != 0xF) {
-                        V[X] = diff;
-                    }
+    if (fleet && play_path) {
+        error("[FAILED] -p plays a movie back on a single machine, it can't be used for fleet runs\n");
+        return 1;
+    }
 
-                    PC += 2;
-                    break;
-                case 0x6:
-                    // Place the value of V[Y] into V[X], shift the value in V[X] 1
-                    // bit to the right, store the shifted bit into V[F]
-                    printf("[OK] 0x%X: 8XY6\n", op);
-                    V[X] = V[Y];
-                    int shifted_bit = V[X] & 0b00000001;
-                    V[X] /= 2;
-                    if (shifted_bit) { // Bit mask to see if last bit is 1;
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
-                    }
-                    PC += 2;
-                    break;
-                case 0x7:
-                    // 0x8XY7: set VX to VY - VX, if VY > VX then VF = 1; 0 otherwise
-                    printf("[OK] 0x%X: 8XY7\n", op);
-                    uint8_t diff2 = V[Y] - V[X];
-
-                    if (V[Y] >= V[X]) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
-                    }
+    if (fleet && port >= 0) {
+        error("[FAILED] -N streams a single machine, it can't be used for fleet runs\n");
+        return 1;
+    }
 
-                    if (X != 0xF) {
-                        V[X] = diff2;
-                    }
+    if (play_path && port >= 0) {
+        error("[FAILED] -p plays a movie back as fast as possible, it can't be streamed with -N\n");
+        return 1;
+    }
 
-                    PC += 2;
-                    break;
-                case 0xE:
-                    // 0x8XYE: If the most significant bit of VX is 1, then VF is set to 1
-                    // otherwise it's set to 0, then V[X] is multiplied by 2;
-                    printf("[OK] 0x%X: 8XYE\n", op);
-                    V[X] = V[Y];
-                    int shifted_bit2 = V[X] & 0b10000000;
-                    V[X] *= 2;
-                    if (shifted_bit2) {
-                        V[0xF] = 1;
-                    } else {
-                        V[0xF] = 0;
-                    }
-                    PC += 2;
-                    break;
-                default:
-                    printf("[ERROR] Some other instruction in the 0x8XYZ that is not implmented was called: %X\n", op);
-                    break;
-            }
-            break;
-        case 0x9:
-            // 0x9XY0: Skip the next instruction if VX != VY;
-            printf("[OK] 0x%X: 9XY0\n", op);
-            if (((op_nibbles & 0x00F) == 0) && V[X] != V[Y]) {
-                PC += 2;
-            }
-            PC += 2;
-            break;
-        case 0xA:
-            // 0xANNN: Set special register I to NNN;
-            printf("[OK] 0x%X: ANNN\n", op);
-            I = op_nibbles;
-            PC += 2;
-            break;
-        case 0xB:
-            // 0xBNNN: set PC to NNN + V0;
-            printf("[OK] 0x%X: BNNN\n", op);
-            PC = V[0] + op_nibbles;
-            break;
-        case 0xC:
-            // 0xCXNN: Set V[X] to a random byte and NN, ie generate a rand int
-            // from 0 to 255 and then do bitwise AND with NN and store it in V[X]
-            printf("[OK] 0x%X: CXNN\n", op);
-            srand(time(NULL));
-            int r = rand() % 255;
-            V[X] = r & (op_nibbles & 0x0FF);
-            PC += 2;
-            break;
-        case 0xD: {
-            // 0xDXYN: display a sprite starting at memory location I at (VX, VY),
-            // use VF for collision bool, Sprites that are read in are XORed onto the display
-            // if any pixels are erased because of this, VF is set to 1, otherwise to 0.
-            // if the sprite is cut off, it should wrap around the screen to the opposite side
-            
-            // Start by isolating the last nibble since that will be the size of the sprite
-            // being displayed.
-            printf("[OK] 0x%X: DXYN\n", op);
-            uint8_t n_bytes = op_nibbles & 0x00F;
-            // Get X and Y coords from VX and VY;
-            uint8_t x_coord = V[X] % SCREEN_WIDTH; // modulo to 'wrap' around in case sprite is too big
-            uint8_t y_coord = V[Y] % SCREEN_HEIGHT; // same reasoning for modulo here.
-            uint8_t combined_display_idx = x_coord + (y_coord * SCREEN_WIDTH); // display is a 1D array
-            unsigned short curr_sprite;
-            // reset V[0xF] to 0 before beginning
-            V[0xF] = 0;
-            // Draw the sprite
-            // outer loop is looping over the height of the sprite, n_bytes represents the height,
-            // inner loop is over the width, each row of the sprite is 8 bits since it is represented
-            // by one byte, at least that's my understanding of it.
-            for (int nth_byte = 0; nth_byte < n_bytes; nth_byte++) {
-                curr_sprite = memory[I + nth_byte];
-                // loop over the bits from the byte grabbed earlier;
-                if (nth_byte + y_coord >= SCREEN_HEIGHT) {
-                    continue;
-                }
-                for (int nth_bit = 0; nth_bit < 8; nth_bit++) {
-                    if ((curr_sprite & (0x80 >> nth_bit)) != 0) {
-                        if (nth_bit + x_coord >= SCREEN_WIDTH) {
-                            continue;
-                        }
-                        // Check if there is a pixel that is already on that will be switched off
-                        if (display[(x_coord + nth_bit + ((y_coord + nth_byte) * SCREEN_WIDTH))] == 1) {
-                            // Set the collision flag to 1 if theres a pixel already on that will
-                            // be shut off.
-                            V[0xF] = 1;
-                        }
-                        // Set display with XOR, what if it needs to clip? There should almost certainly
-                        // require a modulo operation
-                        display[x_coord + nth_bit + ((y_coord + nth_byte) * SCREEN_WIDTH)] ^= 1;
-                    }
-                }
-            }
-            // printf("right before printing display from DXYN");
-            // print_arrays(display, (sizeof(display)/sizeof(display[0])));
-            // printf("right after printing display from DXYN");
-            // draw_on_screen(display);
-            draw_flag = 1;
-            PC += 2;
-            return true;
-        }   break;
-        case 0xE:
-            // two different instructions, 0xEX9E and 0xEXA1;
-            switch (op_nibbles & 0x0FF) {
-                case 0x9E:
-                    // 0xEX9E: skip instruction if the key with the value of VX is pressed
-                    printf("[OK] 0x%X: EX9E\n", op);
-                    if (keypad[V[X]]) {
-                        PC += 2;
-                    }
-                    PC += 2;
-                    break;
-                case 0xA1:
-                    // 0xEXA1: skip instruction if key with value of VX is NOT pressed
-                    printf("[OK] 0x%X: EXA1\n", op);
-                    if (!keypad[V[X]]) {
-                        PC += 2;
-                    }
-                    PC += 2;
-                    break;
-                default:
-                    // shouldn't get here
-                    printf("[ERROR] Unknown op of 0xEXXX: 0x%X\n", op);
-            }
-            break;
-        case 0xF:
-            // Couple of instructions in this opcode type;
-            switch(op_nibbles & 0x0FF) {
-                case 0x07:
-                    // 0xFX07: set VX to the value of the delay timer;
-                    printf("[OK] 0x%X: FX07\n", op);
-                    V[X] = delay_timer;
-                    PC += 2;
-                    break;
-                case 0x0A:
-                    // 0xFX0A: Wait for a keypress, then store the value in VX
-                    // All execution should stop until a key is pressed. Done by not incrementing
-                    // PC until a keypress is found.
-                    printf("[OK] 0x%X: FX0A\n", op);
-
-                    if (key_found && (key_pressed != 255)) {
-                        if (!keypad[key_pressed]) {
-                            key_found = false;
-                            key_pressed = 255;
-                            PC += 2;
-                        }
-                    }
+    if (debugging && (fleet || play_path || port >= 0)) {
+        error("[FAILED] -D debugs a single machine from the console, it can't be used with fleet runs, -p or -N\n");
+        return 1;
+    }
 
-                    for (int i = 0; i < 16; i++) {
-                        if (keypad[i]) {
-                            V[X] = i;
-                            key_found = true;
-                            key_pressed = i;
-                            break;
-                        }
-                    }
+    if (headless && ahead_frames) {
+        error("[FAILED] -A hides input lag in the window, a headless run has nothing to show\n");
+        return 1;
+    }
 
-                    break;
-                case 0x15:
-                    // 0xFX15: opposite of 0xFX07 where this time delay timer is set to value of VX;
-                    printf("[OK] 0x%X: FX15\n", op);
-                    delay_timer = V[X];
-                    PC += 2;
-                    break;
-                case 0x18: 
-                    // 0xFX18: set sound timer to VX
-                    printf("[OK] 0x%X: FX18\n", op);
-                    sound_timer = V[X];
-                    PC += 2;
-                    break;
-                case 0x1E:
-                    // 0xFX1E: set I = I + VX;
-                    printf("[OK] 0x%X: FX1E\n", op);
-                    I += V[X];
-                    PC += 2;
-                    break;
-                case 0x29:
-                    printf("[OK] 0x%X: FX29\n", op);
-                    // 0xFX29: set I = location of sprite for digit VX
-                    // TODO: Don't think this is right.
-                    I = V[X] * 5;
-                    PC += 2;
-                    break;
-                case 0x33: {
-                    // 0xFX33: Store BCD representation of VX in mem locations I, I + 1, I + 2;
-                    // take the decimal value of VX, placing hundreds digit at I, tens at I + 1, ones at I + 2;
-                    printf("[OK] 0x%X: FX33\n", op);
-                    unsigned char vx_value = V[X];
-                    unsigned char hundreds = vx_value / 100;
-                    unsigned char tens = (vx_value % 100) / 10;
-                    unsigned char ones = vx_value % 10;
-
-                    printf("VX value: %d\n X value: %X\n", vx_value, X);
-                    memory[I] = hundreds;
-                    memory[I + 1] = tens;
-                    memory[I + 2] = ones;
-                    printf("hundreds value: %d\n", hundreds);
-                    printf("value at mem[I] (hundreds): %d\n", memory[I]);
-                    printf("tens value: %d\n", tens);
-                    printf("value at mem[I + 1] (tens): %d\n", memory[I + 1]);
-                    printf("ones value: %d\n", ones);
-                    printf("value at mem[I + 2] (ones): %d\n", memory[I + 2]);
-
-
-                    PC += 2;
-                    
-                } break; 
-                case 0x55:
-                    // 0xFX55: Store registers V0-VX in memory start at location I;
-                    // Copy the values from the registers into memory starting at I
-                    printf("[OK] 0x%X: FX55\n", op);
-                    printf("value of X is: %d\n", X);
-                    for (int i = 0; i <= X; i++) {
-                        memory[I + i] = V[i];
-                        printf("value of i is: %d\n", i);
-                        printf("value of V[i] is: %d\n value of memory[I + i] is: %d\n", V[i], memory[I + i]);
-                    }
-                    I += 15;
-                    PC += 2;
-                    break;
-                case 0x65:
-                    // 0xFX65: Read registers V0-VX from memory starting at location I;
-                    // Read values from memory into the registers.
-                    printf("[OK] 0x%X: FX65\n", op);
-                    for (int i = 0; i <= X; i++) {
-                        V[i] = memory[I + i];
-                    }
-                    I += 15;
-                    PC += 2;
-                    break;
-            }
-            break;
-        default:
-            error("[ERROR] Unknown opcode encountered: 0x%X\n", op);
+    if (headless && record_path) {
+        error("[FAILED] -M records the window's input, there's none in a headless run\n");
+        return 1;
+    }
+
+    if (headless && !play_path && port < 0 && !debugging && max_instructions == UINT64_MAX && max_frames == UINT64_MAX) {
+        error("[FAILED] a headless run needs a limit, pass -n or -f\n");
+        return 1;
     }
-    return false;
-}
 
-///////////////////////////////
-// EMULATION CYCLE HANDLER   //
-///////////////////////////////
+#ifndef CHIP8_TRACE
+    if (trace_path) {
+        error("[FAILED] -t needs a build configured with -DCHIP8_TRACE=ON\n");
+        return 1;
+    }
+#endif
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        perror("Usage: emulator rom.ch8");
+#ifndef CHIP8_PROFILE
+    if (profile_path) {
+        error("[FAILED] -P needs a build configured with -DCHIP8_PROFILE=ON\n");
+        return 1;
+    }
+#endif
+
+    if (fleet && profile_path) {
+        error("[FAILED] -P profiles a single machine, it can't be used for fleet runs\n");
+        return 1;
+    }
+
+    if (fleet && capture_path) {
+        error("[FAILED] -C captures a single machine, it can't be used for fleet runs\n");
         return 1;
     }
 
+    if (fleet && trace_path) {
+        error("[FAILED] -t traces a single machine, it can't be used for fleet runs\n");
+        return 1;
+    }
+
+    if (fleet && (save_path || load_path)) {
+        error("[FAILED] -S and -L save and load a single machine, they can't be used for fleet runs\n");
+        return 1;
+    }
+
+    if (fleet) {
+        // every rom gets loaded once up front, instances copy from there
+        Corpus corpus;
+        corpus_init(&corpus);
+        for (int i = optind; i < argc; i++) {
+            if (!corpus_add(&corpus, argv[i])) {
+                perror(argv[i]);
+                corpus_free(&corpus);
+                return 1;
+            }
+        }
+        printf("[OK] Loaded %d roms, %d rejected\n", corpus.count, corpus.rejected);
+        if (corpus.count == 0) {
+            error("[FAILED] No roms to run\n");
+            corpus_free(&corpus);
+            return 1;
+        }
+
+        if (instances <= 0) {
+            instances = corpus.count;
+        }
+        printf("[OK] Random seed %llu\n", (unsigned long long)seed);
+        int status = run_fleet(&corpus, instances, threads, core, variant, quirks, batch, max_instructions, max_frames, seed);
+        corpus_free(&corpus);
+        return status;
+    }
+
+    // a movie brings the seed, variant and quirks it was recorded with
+    MovieReader* movie = NULL;
+    if (play_path) {
+        movie = movie_open(play_path);
+        if (movie == NULL) {
+            error("[FAILED] %s is not a movie this build can play\n", play_path);
+            return 1;
+        }
+        seed = movie->header.seed;
+        variant = movie->header.variant;
+        quirks = movie->header.quirks;
+        printf("[OK] Playing %s, random seed %llu at %llu ips\n", play_path,
+               (unsigned long long)seed, (unsigned long long)movie->header.ips);
+    }
+
     printf("[PENDING] Initializing CHIP-8 interpreter\n");
-    init_cpu();
+    Chip8* c8 = chip8_create(core, seed);
+    if (c8 == NULL) {
+        error("[FAILED] Could not set up the interpreter core\n");
+        return 1;
+    }
     printf("[OK] Done!");
 
-    char* ptr;
-
-    char* rom = argv[1];
-    // int CYCLE_LEN = strtol(argv[1], &ptr, 10); // Recommended is around ~1400
-    printf("[PENDING] Loading rom %s... \n", rom);
-    int err_check_load_rom = load_rom(rom);
+    char* rom = argv[optind];
+    if (!chip8_set_variant(c8, variant < 0 ? variant_for_rom(rom) : (Chip8Variant)variant)) {
+        error("[FAILED] Out of memory\n");
+        chip8_destroy(c8);
+        return 1;
+    }
+    if (quirks >= 0) {
+        chip8_set_quirks(c8, (Chip8Quirks)quirks);
+    }
+    printf("[PENDING] Loading %s rom %s with %s quirks... \n", variant_name(c8->variant), rom, quirks_name(c8->quirks));
+    int err_check_load_rom = load_rom(c8, rom);
     if (err_check_load_rom) {
         if (err_check_load_rom == -1) {
             error("[FAILED] fread() failure: the return value is not equal to the rom file size.");
@@ -689,54 +968,302 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    printf("[OK] Rom loaded successfully!\n");
+    printf("[OK] Rom loaded successfully! Hash %08X\n", movie_rom_hash(c8));
+
+    if (presets_path) {
+        Presets presets;
+        presets_init(&presets);
+        int bad_line;
+        if (!presets_load(&presets, presets_path, &bad_line)) {
+            if (bad_line) {
+                error("[FAILED] %s:%d is not a hash and instructions per second\n", presets_path, bad_line);
+            } else {
+                perror("Error while loading presets");
+            }
+            presets_free(&presets);
+            return 1;
+        }
+        uint64_t preset = presets_ips(&presets, movie_rom_hash(c8));
+        presets_free(&presets);
+        if (preset && !ips_given) {
+            ips = preset;
+            printf("[OK] Running at the rom's preset %llu ips\n", (unsigned long long)ips);
+        }
+    }
 
-    init_sdl_display();
-    printf("[OK] Display initialized\n");
+    if (movie && movie_rom_hash(c8) != movie->header.rom_hash) {
+        error("[FAILED] %s was recorded on a different rom\n", play_path);
+        return 1;
+    }
 
-    const uint32_t frame_time = 16;
-    const uint32_t timer_freq = 60;
-    uint32_t last_draw_time = 0;
-    uint32_t last_timer_update = 0;
-    uint32_t current_time = SDL_GetTicks();
+    // the header hashes the rom as loaded, so this goes before -L
+    MovieWriter* recording = NULL;
+    if (record_path) {
+        recording = movie_record(record_path, c8, ips);
+        if (recording == NULL) {
+            perror("Error while opening movie");
+            return 1;
+        }
+        rewind_mb = 0;
+        printf("[OK] Recording input to %s, rewind and quick loads are off\n", record_path);
+    }
 
-    while (!should_quit) {
-        if (current_time - last_timer_update >= 1000 / timer_freq) {
-            bool draw_occurred = false;
+    if (load_path) {
+        if (!savestate_read_file(c8, load_path)) {
+            error("[FAILED] %s is not a savestate this build can load\n", load_path);
+            return 1;
+        }
+        printf("[OK] Savestate %s loaded\n", load_path);
+    }
 
-            for (int i = 0; i < 16; i++) {
-                draw_occurred = emulate_cycle();
-                if (draw_occurred) break;
-            }
+#ifdef CHIP8_TRACE
+    if (trace_path) {
+        c8->trace = trace_open(trace_path);
+        if (c8->trace == NULL) {
+            perror("Error while opening trace file");
+            return 1;
+        }
+        printf("[OK] Tracing to %s\n", trace_path);
+    }
+#endif
+
+#ifdef CHIP8_PROFILE
+    if (profile_path) {
+        c8->profile = profile_create();
+        if (c8->profile == NULL) {
+            error("[FAILED] Could not allocate the profile\n");
+            return 1;
+        }
+        profile_install_signal();
+        printf("[OK] Profiling, snapshots go to %s\n", profile_path);
+    }
+#endif
+
+    // after -L, the capture starts where the run does
+    if (capture_path) {
+        c8->capture = capture_open(capture_path, c8, CAPTURE_SCALE);
+        if (c8->capture == NULL) {
+            perror("Error while opening capture");
+            return 1;
+        }
+        printf("[OK] Capturing to %s\n", capture_path);
+    }
+
+    // the window's emulator thread parks on FX0A until a key event, keys
+    // from stream viewers have to wake it as well
+    if (!headless) {
+        input.key_event = SDL_CreateSemaphore(0);
+    }
+
+    Stream* stream = NULL;
+    if (port >= 0) {
+        stream = stream_open((uint16_t)port, STREAM_VIEWERS, input.key_event ? post_key_event : NULL, input.key_event);
+        if (stream == NULL) {
+            perror("Error while opening stream");
+            return 1;
+        }
+        printf("[OK] Streaming on port %d\n", port);
+    }
+
+    if (debugging) {
+        c8->debug = debugger_create();
+        if (c8->debug == NULL) {
+            error("[FAILED] Could not allocate the debugger\n");
+            return 1;
+        }
+        debug_console(c8, ips, stdin, stdout);
+        debugger_free(c8->debug);
+        c8->debug = NULL;
+        if (save_path && !savestate_write_file(c8, save_path)) {
+            perror("Error while writing savestate");
+            return 1;
+        }
+#ifdef CHIP8_PROFILE
+        if (c8->profile) {
+            write_profile(c8->profile, profile_path);
+            profile_free(c8->profile);
+        }
+#endif
+#ifdef CHIP8_TRACE
+        trace_close(c8->trace);
+#endif
+        if (!capture_close(c8->capture)) {
+            perror("Error while writing capture");
+        }
+        chip8_destroy(c8);
+        return 0;
+    }
 
-            if (draw_flag) {
-                draw_on_screen(display);
-                draw_flag = 0;
-                
-                last_draw_time = current_time;
+    if (headless) {
+        struct timespec start;
+        uint64_t frames;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint64_t instructions = 0;
+#ifdef CHIP8_PROFILE
+        if (c8->profile && !movie && !stream) {
+            // a frame at a time so a SIGUSR1 gets its snapshot while running
+            frames = 0;
+            while (instructions < max_instructions && frames < max_frames) {
+                uint64_t frame;
+                instructions += run_headless(c8, max_instructions - instructions, 1, &frame);
+                frames += frame;
+                poll_profile(c8->profile, profile_path);
             }
+        } else
+#endif
+        if (movie) {
+            instructions = movie_play(c8, movie, max_instructions, max_frames, &frames);
+            movie_free(movie);
+        } else if (stream) {
+            signal(SIGINT, stop_running);
+            signal(SIGTERM, stop_running);
+            instructions = run_streamed(c8, stream, ips, max_instructions, max_frames, &frames);
+            stream_close(stream);
+        } else {
+            instructions = run_headless(c8, max_instructions, max_frames, &frames);
+        }
+        double elapsed = seconds_since(&start);
+
+        dump_state(c8);
+
+        printf("instructions: %llu\n", (unsigned long long)instructions);
+        printf("frames: %llu\n", (unsigned long long)frames);
+        printf("elapsed: %.6fs\n", elapsed);
+        printf("instructions per second: %.0f\n", elapsed > 0 ? instructions / elapsed : 0.0);
+        if (save_path && !savestate_write_file(c8, save_path)) {
+            perror("Error while writing savestate");
+            return 1;
+        }
+#ifdef CHIP8_PROFILE
+        if (c8->profile) {
+            write_profile(c8->profile, profile_path);
+            profile_free(c8->profile);
+        }
+#endif
+#ifdef CHIP8_TRACE
+        trace_close(c8->trace);
+#endif
+        if (!capture_close(c8->capture)) {
+            perror("Error while writing capture");
+        }
+        chip8_destroy(c8);
+        return 0;
+    }
+
+    init_sdl_display(vsync);
+    printf("[OK] Display initialized\n");
+
+    frame_event = SDL_RegisterEvents(1);
+
+    Emulation* emu = calloc(1, sizeof(Emulation));
+    if (emu == NULL) {
+        error("[FAILED] Out of memory\n");
+        return 1;
+    }
+    emu->c8 = c8;
+    frames_init(&emu->frames);
+    emu->audio = mute ? NULL : audio_open();
+    // one delta per frame goes into the rewind buffer, holding backspace
+    // pops one back per frame instead of running
+    emu->rewind = rewind_mb ? rewind_create(rewind_mb << 20) : NULL;
+    emu->movie = recording;
+    emu->stream = stream;
+    // the copy runs on the switch core, the others would have to throw their
+    // caches away on every copy
+    if (ahead_frames) {
+        emu->ahead = chip8_create(CORE_SWITCH, seed);
+        if (emu->ahead == NULL || !size_memory(emu->ahead, c8->variant)) {
+            error("[FAILED] Could not set up the run-ahead machine\n");
+            return 1;
+        }
+        emu->run_ahead = ahead_frames;
+        printf("[OK] Running %d frames ahead\n", ahead_frames);
+    }
+    emu->ips = ips;
+    emu->turbo = turbo < 0 ? DEFAULT_TURBO : (uint64_t)turbo;
+    atomic_store(&input.turbo, turbo >= 0);
+    emu->save_path = save_path;
+    emu->profile_path = profile_path;
+
+    SDL_Thread* thread = SDL_CreateThread(emulate, "emulator", emu);
+    if (thread == NULL) {
+        error("[FAILED] Could not start the emulator thread: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    // This thread only turns events into input and draws the newest frame.
+    // It sleeps until there is either an event or a frame_event, and works
+    // out the changed rows itself against what it drew last, so skipped
+    // frames don't matter. The texture starts out undefined, draw it all.
+    static Frame shown;
+    window_exposed = true;
 
-            // Decrement the timers if needed:
-            if (delay_timer > 0) {
-                delay_timer -= 1;
-                printf("delay_timer: %i\n", delay_timer);
+    while (!should_quit) {
+        SDL_Event event;
+        if (SDL_WaitEventTimeout(&event, WAIT_TIMEOUT_MS)) {
+            handle_event(&event);
+            sdl_handler();
+        }
+
+        uint64_t dirty_rows = 0;
+        const Frame* latest = frames_consume(&emu->frames);
+        if (latest) {
+            if (latest->hires != shown.hires) {
+                dirty_rows = ALL_ROWS;
             }
-            if (sound_timer > 0){
-                sound_timer -= 1;
-                printf("sound_timer: %i\n", sound_timer);
+            for (int y = 0; y < HIRES_HEIGHT; y++) {
+                for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+                    if (memcmp(latest->display[plane][y], shown.display[plane][y], sizeof(shown.display[plane][y])) != 0) {
+                        dirty_rows |= 1ull << y;
+                    }
+                }
             }
-
-            uint32_t time_since_last_draw = current_time - last_draw_time;
-            if (time_since_last_draw < frame_time) {
-                SDL_Delay(frame_time - time_since_last_draw);
+            memcpy(shown.display, latest->display, sizeof(shown.display));
+            shown.hires = latest->hires;
+            if (latest->press_time && !input.sampled_press) {
+                input.sampled_press = latest->press_time;
             }
-
-            sdl_handler(keypad);
         }
 
+        // returns straight away unless a row changed or the window needs
+        // repainting, with -V the present blocks until the next refresh
+        draw_on_screen(&shown.display[0][0][0], shown.hires, dirty_rows);
+    }
+
+    SDL_WaitThread(thread, NULL);
+
+    if (!movie_close(emu->movie)) {
+        perror("Error while writing movie");
     }
+    // the stream's thread posts key_event, stop it first
+    stream_close(emu->stream);
+    SDL_DestroySemaphore(input.key_event);
 
+    if (save_path && !savestate_write_file(c8, save_path)) {
+        perror("Error while writing savestate");
+    }
+
+    rewind_free(emu->rewind);
+    chip8_destroy(emu->ahead);
+    print_input_latency();
+    governor_report(&emu->governor, stdout);
+    audio_close(emu->audio);
+    free(emu);
     stop_display();
+#ifdef CHIP8_PROFILE
+    if (c8->profile) {
+        write_profile(c8->profile, profile_path);
+        profile_free(c8->profile);
+    }
+#endif
+#ifdef CHIP8_TRACE
+    trace_close(c8->trace);
+#endif
+    if (!capture_close(c8->capture)) {
+        perror("Error while writing capture");
+    }
+    chip8_destroy(c8);
     return 0;
 
 }
@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/movie.h"
+
+// Runs change at human speed, 4k of them is minutes of slack for the writer.
+#define MOVIE_RING_RUNS     4096
+#define MOVIE_BATCH         256
+
+// a run is 2 bytes of keys and at most 5 of varint
+#define MOVIE_RUN_BYTES     7
+
+// FNV-1a over everything a rom could have written at load, the rom itself
+// and the zeroes after it, so it doesn't need the rom's size.
+uint32_t movie_rom_hash(const Chip8* c8) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0x200; i <= c8->memory_mask; i++) {
+        hash = (hash ^ c8->memory[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t encode_run(const MovieRun* run, uint8_t* out) {
+
+    memcpy(out, &run->keys, sizeof(run->keys));
+    size_t size = sizeof(run->keys);
+    uint32_t frames = run->frames;
+    do {
+        uint8_t byte = frames & 0x7F;
+        frames >>= 7;
+        out[size++] = byte | (frames ? 0x80 : 0);
+    } while (frames);
+    return size;
+
+}
+
+static void write_runs(void* user, const void* batch, size_t count) {
+    MovieWriter* movie = user;
+    const MovieRun* runs = batch;
+    uint8_t encoded[MOVIE_BATCH * MOVIE_RUN_BYTES];
+
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += encode_run(&runs[i], encoded + size);
+    }
+    fwrite(encoded, 1, size, movie->file);
+}
+
+// Start recording a run of c8, which has to have its rom loaded and nothing
+// run yet. The header takes the machine's variant, quirks and seed, so those
+// have to be set already too.
+MovieWriter* movie_record(const char* path, const Chip8* c8, uint64_t ips) {
+
+    MovieWriter* movie = calloc(1, sizeof(MovieWriter));
+    if (movie == NULL) {
+        return NULL;
+    }
+
+    movie->file = fopen(path, "wb");
+    if (movie->file == NULL) {
+        free(movie);
+        return NULL;
+    }
+
+    MovieHeader header = {0};
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    header.version = MOVIE_VERSION;
+    header.variant = c8->variant;
+    header.quirks = c8->quirks;
+    header.seed = c8->seed;
+    header.ips = ips;
+    header.rom_hash = movie_rom_hash(c8);
+    fwrite(&header, sizeof(header), 1, movie->file);
+
+    if (!ring_writer_start(&movie->writer, MOVIE_RING_RUNS, sizeof(MovieRun), MOVIE_BATCH,
+                           10000000, write_runs, movie)) {
+        fclose(movie->file);
+        free(movie);
+        return NULL;
+    }
+
+    return movie;
+
+}
+
+// Never drops a run, a movie with a hole in it is worthless.
+static void push_run(MovieWriter* movie) {
+    ring_push_wait(&movie->writer.ring, &movie->run);
+}
+
+// The keys the frame about to run got, call it once per frame.
+void movie_frame(MovieWriter* movie, uint16_t keys) {
+    if (movie->run.frames && movie->run.keys == keys && movie->run.frames < UINT32_MAX) {
+        movie->run.frames++;
+        return;
+    }
+    if (movie->run.frames) {
+        push_run(movie);
+    }
+    movie->run.keys = keys;
+    movie->run.frames = 1;
+}
+
+// Write out the last run and close the file. Returns false if any of it
+// didn't make it to disk.
+bool movie_close(MovieWriter* movie) {
+
+    if (movie == NULL) {
+        return true;
+    }
+
+    if (movie->run.frames) {
+        push_run(movie);
+    }
+    ring_writer_stop(&movie->writer);
+
+    bool ok = !ferror(movie->file);
+    ok = fclose(movie->file) == 0 && ok;
+    free(movie);
+    return ok;
+
+}
+
+// Open a movie for playback, NULL if it can't be read or isn't a movie this
+// build knows.
+MovieReader* movie_open(const char* path) {
+
+    MovieReader* movie = calloc(1, sizeof(MovieReader));
+    if (movie == NULL) {
+        return NULL;
+    }
+
+    movie->file = fopen(path, "rb");
+    if (movie->file == NULL) {
+        free(movie);
+        return NULL;
+    }
+
+    if (fread(&movie->header, sizeof(movie->header), 1, movie->file) != 1
+            || memcmp(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic)) != 0
+            || movie->header.version != MOVIE_VERSION
+            || movie->header.variant > VARIANT_XOCHIP
+            || movie->header.quirks >= QUIRKS_COUNT
+            || movie->header.ips == 0) {
+        movie_free(movie);
+        return NULL;
+    }
+
+    return movie;
+
+}
+
+// The next run, false at the end of the movie (a run cut off by the end of
+// the file counts as the end too).
+bool movie_next(MovieReader* movie, MovieRun* run) {
+
+    if (fread(&run->keys, sizeof(run->keys), 1, movie->file) != 1) {
+        return false;
+    }
+
+    run->frames = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = fgetc(movie->file);
+        if (byte == EOF) {
+            return false;
+        }
+        run->frames |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+
+}
+
+void movie_free(MovieReader* movie) {
+    if (movie == NULL) {
+        return;
+    }
+    fclose(movie->file);
+    free(movie);
+}
+
+// Play a movie back on c8 (set up with the header's variant, quirks and seed
+// and the rom loaded) as fast as the host allows: every frame gets the keys
+// and the share of the instructions per second it got in the window, then
+// its timer tick. At the window's default rate that's HEADLESS_INSTRUCTIONS
+// a frame and frames an idle machine would spin through while the keys stay
+// put get skipped like run_headless() does. Stops at the end of the movie or
+// either limit. Returns the number of instructions executed, frames_run gets
+// the frame count.
+uint64_t movie_play(Chip8* c8, MovieReader* movie, uint64_t max_instructions, uint64_t max_frames, uint64_t* frames_run) {
+
+    uint64_t ips = movie->header.ips;
+    bool uniform = ips == FRAME_RATE * HEADLESS_INSTRUCTIONS;
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    MovieRun run;
+
+    while (instructions < max_instructions && frames < max_frames && movie_next(movie, &run)) {
+        chip8_set_keys(c8, run.keys);
+        uint64_t end = run.frames < max_frames - frames ? frames + run.frames : max_frames;
+
+        while (instructions < max_instructions && frames < end) {
+            uint64_t budget = frame_instructions(frames, ips);
+            if (budget > INT32_MAX) {
+                budget = INT32_MAX;
+            }
+            if (budget > max_instructions - instructions) {
+                budget = max_instructions - instructions;
+            }
+            instructions += run_instructions(c8, (int)budget);
+            if (uniform) {
+                uint64_t ended = end_headless_frame(c8, max_instructions - instructions, end - frames);
+                instructions += (ended - 1) * HEADLESS_INSTRUCTIONS;
+                frames += ended;
+            } else {
+                c8->draw_flag = 0;
+                tick_timers(c8);
+                frames++;
+            }
+        }
+    }
+
+    if (frames_run) {
+        *frames_run = frames;
+    }
+
+    return instructions;
+
+}
@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "include/chip8.h"
+#include "include/corpus.h"
+
+// Packs roms into one corpus file for `mygame -H` fleet runs, so a sweep
+// over thousands of roms maps one file instead of opening every rom:
+//
+//     chip8_pack corpus.c8pk roms/ more_roms/ extra.ch8
+
+int main(int argc, char** argv) {
+
+    if (argc < 3) {
+        error("Usage: chip8_pack out.c8pk rom.ch8|directory|corpus.c8pk ...\n");
+        return 1;
+    }
+
+    Corpus corpus;
+    corpus_init(&corpus);
+
+    for (int i = 2; i < argc; i++) {
+        if (!corpus_add(&corpus, argv[i])) {
+            perror(argv[i]);
+            corpus_free(&corpus);
+            return 1;
+        }
+    }
+
+    if (!corpus_write(&corpus, argv[1])) {
+        perror("Error while writing corpus");
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    printf("[OK] Packed %d roms into %s, %d rejected\n", corpus.count, argv[1], corpus.rejected);
+    corpus_free(&corpus);
+    return 0;
+
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/presets.h"
+
+// the longest line a presets file can have
+#define PRESET_LINE     512
+
+void presets_init(Presets* presets) {
+    memset(presets, 0, sizeof(Presets));
+}
+
+void presets_free(Presets* presets) {
+    free(presets->presets);
+    presets_init(presets);
+}
+
+static bool add_preset(Presets* presets, uint32_t hash, uint64_t ips) {
+    if (presets->count == presets->capacity) {
+        int capacity = presets->capacity ? presets->capacity * 2 : 64;
+        Preset* grown = realloc(presets->presets, capacity * sizeof(Preset));
+        if (grown == NULL) {
+            return false;
+        }
+        presets->presets = grown;
+        presets->capacity = capacity;
+    }
+    presets->presets[presets->count].hash = hash;
+    presets->presets[presets->count].ips = ips;
+    presets->count++;
+    return true;
+}
+
+// Add the presets in the file at path, a later line for the same hash wins.
+// False with errno set when the file can't be read or memory runs out, or
+// with bad_line set to the (1-based) number of a line that isn't a preset.
+bool presets_load(Presets* presets, const char* path, int* bad_line) {
+
+    *bad_line = 0;
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[PRESET_LINE];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        number++;
+        char* at = line + strspn(line, " \t");
+        if (*at == '#' || *at == '\n' || *at == '\0') {
+            continue;
+        }
+        unsigned long hash;
+        unsigned long long ips;
+        if (sscanf(at, "%lx %llu", &hash, &ips) != 2 || hash > UINT32_MAX || ips == 0) {
+            *bad_line = number;
+            ok = false;
+        } else {
+            ok = add_preset(presets, (uint32_t)hash, ips);
+        }
+    }
+
+    fclose(file);
+    return ok;
+
+}
+
+// The preset rate for the rom with this hash, 0 when there's none.
+uint64_t presets_ips(const Presets* presets, uint32_t hash) {
+    for (int i = presets->count - 1; i >= 0; i--) {
+        if (presets->presets[i].hash == hash) {
+            return presets->presets[i].ips;
+        }
+    }
+    return 0;
+}
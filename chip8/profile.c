@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include "include/chip8.h"
+#include "include/decode.h"
+#include "include/profile.h"
+
+volatile sig_atomic_t profile_requested = 0;
+
+#define CHIP8_OP_NAME(name) #name,
+static const char* op_names[OP_COUNT] = { CHIP8_OPS(CHIP8_OP_NAME) };
+#undef CHIP8_OP_NAME
+
+Profile* profile_create(void) {
+    return calloc(1, sizeof(Profile));
+}
+
+void profile_free(Profile* profile) {
+    free(profile);
+}
+
+static void on_sigusr1(int sig) {
+    (void)sig;
+    profile_requested = 1;
+}
+
+void profile_install_signal(void) {
+    struct sigaction action = {0};
+    action.sa_handler = on_sigusr1;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+// Smallest bucket that holds at least `fraction` of the samples, reported
+// as the bucket's upper bound in ticks.
+static uint64_t percentile(const uint64_t* buckets, uint64_t samples, double fraction) {
+    uint64_t seen = 0;
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= samples * fraction) {
+            return 2ull << b;
+        }
+    }
+    return 2ull << (PROFILE_BUCKETS - 1);
+}
+
+static void write_ops(const Profile* profile, FILE* out) {
+    bool first = true;
+    fprintf(out, "  \"ops\": {\n");
+    for (int h = 0; h < OP_COUNT; h++) {
+        if (profile->count[h] == 0) {
+            continue;
+        }
+
+        const uint64_t* buckets = profile->latency[h];
+        uint64_t samples = 0;
+        int top = -1;
+        for (int b = 0; b < PROFILE_BUCKETS; b++) {
+            samples += buckets[b];
+            if (buckets[b]) {
+                top = b;
+            }
+        }
+
+        fprintf(out, "%s    \"%s\": {\"count\": %llu, \"samples\": %llu", first ? "" : ",\n",
+                op_names[h], (unsigned long long)profile->count[h], (unsigned long long)samples);
+        if (samples) {
+            fprintf(out, ", \"p50_ticks\": %llu, \"p99_ticks\": %llu, \"log2_ticks\": [",
+                    (unsigned long long)percentile(buckets, samples, 0.50),
+                    (unsigned long long)percentile(buckets, samples, 0.99));
+            for (int b = 0; b <= top; b++) {
+                fprintf(out, "%s%llu", b ? ", " : "", (unsigned long long)buckets[b]);
+            }
+            fprintf(out, "]");
+        }
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "\n  },\n");
+}
+
+static void write_hot_pcs(const Profile* profile, FILE* out) {
+    // one pass over all 64K counters (XO-CHIP's memory, a CHIP-8 rom only
+    // touches the first 4K) with insertion into a short sorted list, which
+    // is plenty for a snapshot taken on a signal or at exit
+    uint16_t top[PROFILE_TOP_PCS];
+    int found = 0;
+    for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+        uint64_t hits = profile->pc_hits[pc];
+        if (hits == 0 || (found == PROFILE_TOP_PCS && hits <= profile->pc_hits[top[found - 1]])) {
+            continue;
+        }
+        int i = found < PROFILE_TOP_PCS ? found++ : found - 1;
+        while (i > 0 && profile->pc_hits[top[i - 1]] < hits) {
+            top[i] = top[i - 1];
+            i--;
+        }
+        top[i] = pc;
+    }
+
+    fprintf(out, "  \"hot_pcs\": [");
+    for (int i = 0; i < found; i++) {
+        fprintf(out, "%s{\"pc\": \"0x%03X\", \"hits\": %llu}", i ? ", " : "", top[i],
+                (unsigned long long)profile->pc_hits[top[i]]);
+    }
+    fprintf(out, "],\n");
+}
+
+void profile_write(const Profile* profile, FILE* out) {
+
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"frames\": %llu,\n  \"sample_period\": %d,\n",
+            (unsigned long long)profile->instructions, (unsigned long long)profile->frames,
+            PROFILE_SAMPLE_PERIOD);
+
+    write_ops(profile, out);
+    write_hot_pcs(profile, out);
+
+    fprintf(out, "  \"dxyn_clipped\": %llu,\n  \"fx0a_spins\": %llu,\n  \"draws_per_frame\": [",
+            (unsigned long long)profile->dxyn_clipped, (unsigned long long)profile->fx0a_spins);
+    for (int d = 0; d <= PROFILE_MAX_DRAWS; d++) {
+        fprintf(out, "%s%llu", d ? ", " : "", (unsigned long long)profile->draws_per_frame[d]);
+    }
+    fprintf(out, "]\n}\n");
+    fflush(out);
+
+}
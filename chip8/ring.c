@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+#include "include/ring.h"
+
+void ring_push_wait(Ring* ring, const void* elem) {
+    while (!ring_push(ring, elem)) {
+        sched_yield();
+    }
+}
+
+static void* ring_writer_main(void* arg) {
+    RingWriter* writer = arg;
+
+    for (;;) {
+        // Read the flag before draining so a push that lands right before
+        // ring_writer_stop() still gets drained on the final pass.
+        bool stopping = atomic_load(&writer->stop);
+        size_t count;
+        size_t drained = 0;
+
+        while ((count = ring_pop(&writer->ring, writer->batch, writer->batch_size)) > 0) {
+            writer->drain(writer->user, writer->batch, count);
+            drained += count;
+        }
+
+        if (stopping) {
+            break;
+        }
+        if (drained == 0) {
+            struct timespec nap = {0, writer->nap_ns};
+            nanosleep(&nap, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+// Set up the ring (capacity a power of two) and start the thread, false with
+// nothing left allocated if either fails.
+bool ring_writer_start(RingWriter* writer, size_t capacity, size_t elem_size, size_t batch_size,
+                       long nap_ns, RingDrain drain, void* user) {
+
+    writer->batch = malloc(batch_size * elem_size);
+    if (writer->batch == NULL) {
+        return false;
+    }
+    if (!ring_init(&writer->ring, capacity, elem_size)) {
+        free(writer->batch);
+        return false;
+    }
+
+    writer->batch_size = batch_size;
+    writer->nap_ns = nap_ns;
+    writer->drain = drain;
+    writer->user = user;
+    atomic_init(&writer->stop, false);
+    if (pthread_create(&writer->thread, NULL, ring_writer_main, writer)) {
+        ring_free(&writer->ring);
+        free(writer->batch);
+        return false;
+    }
+    return true;
+
+}
+
+// Drain whatever is still queued, join the thread and free the ring.
+void ring_writer_stop(RingWriter* writer) {
+    atomic_store(&writer->stop, true);
+    pthread_join(writer->thread, NULL);
+    ring_free(&writer->ring);
+    free(writer->batch);
+}
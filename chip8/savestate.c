@@ -0,0 +1,307 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/ops.h"
+#include "include/savestate.h"
+
+// Zero runs shorter than this are cheaper to carry along inside a literal
+// than to end the run over (every run costs a 4 byte skip/count pair).
+#define REWIND_MIN_GAP  4
+
+#define PUT(field) (memcpy(out, &(field), sizeof(field)), out += sizeof(field))
+#define GET(field) (memcpy(&(field), in, sizeof(field)), in += sizeof(field))
+
+// The size of c8's savestates, at most SAVESTATE_MAX_SIZE.
+size_t savestate_size(const Chip8* c8) {
+    return SAVESTATE_SIZE((size_t)c8->memory_mask + 1);
+}
+
+size_t savestate_save(const Chip8* c8, uint8_t* blob) {
+
+    SavestateHeader header;
+    memcpy(header.magic, SAVESTATE_MAGIC, sizeof(header.magic));
+    header.version = SAVESTATE_VERSION;
+    header.size = (uint32_t)savestate_size(c8);
+
+    uint8_t variant = c8->variant;
+    size_t memory = (size_t)c8->memory_mask + 1;
+
+    uint8_t* out = blob;
+    PUT(header);
+    memcpy(out, c8->memory, memory);
+    out += memory;
+    PUT(c8->V);
+    PUT(c8->I);
+    PUT(c8->PC);
+    PUT(c8->stack);
+    PUT(c8->stack_idx);
+    PUT(c8->display);
+    PUT(c8->hires);
+    PUT(c8->planes);
+    PUT(c8->delay_timer);
+    PUT(c8->sound_timer);
+    PUT(c8->pattern);
+    PUT(c8->has_pattern);
+    PUT(c8->pitch);
+    PUT(c8->rpl);
+    PUT(c8->key_found);
+    PUT(c8->key_pressed);
+    PUT(c8->rng);
+    PUT(variant);
+
+    return out - blob;
+
+}
+
+bool savestate_load(Chip8* c8, const uint8_t* blob, size_t size) {
+
+    SavestateHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, blob, sizeof(header));
+    size_t expected = savestate_size(c8);
+    if (memcmp(header.magic, SAVESTATE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SAVESTATE_VERSION || header.size != expected
+        || size < expected || blob[expected - 1] != c8->variant) {
+        return false;
+    }
+
+    size_t memory = (size_t)c8->memory_mask + 1;
+    const uint8_t* in = blob + sizeof(header);
+    memcpy(c8->memory, in, memory);
+    in += memory;
+    GET(c8->V);
+    GET(c8->I);
+    GET(c8->PC);
+    GET(c8->stack);
+    GET(c8->stack_idx);
+    GET(c8->display);
+    GET(c8->hires);
+    GET(c8->planes);
+    GET(c8->delay_timer);
+    GET(c8->sound_timer);
+    GET(c8->pattern);
+    GET(c8->has_pattern);
+    GET(c8->pitch);
+    GET(c8->rpl);
+    GET(c8->key_found);
+    GET(c8->key_pressed);
+    GET(c8->rng);
+
+    // the whole of memory changed as far as the caches know, and the whole
+    // screen as far as the renderer knows
+    mem_written(c8, 0, c8->memory_mask + 1);
+    c8->dirty_rows = ~0ull;
+    c8->draw_flag = 1;
+
+    return true;
+
+}
+
+bool savestate_write_file(const Chip8* c8, const char* path) {
+
+    uint8_t blob[SAVESTATE_MAX_SIZE];
+    size_t size = savestate_save(c8, blob);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(blob, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+
+}
+
+bool savestate_read_file(Chip8* c8, const char* path) {
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    uint8_t blob[SAVESTATE_MAX_SIZE];
+    size_t size = fread(blob, 1, sizeof(blob), file);
+    fclose(file);
+
+    return savestate_load(c8, blob, size);
+
+}
+
+Rewind* rewind_create(size_t capacity) {
+
+    Rewind* rewind = calloc(1, sizeof(Rewind));
+    if (rewind == NULL) {
+        return NULL;
+    }
+
+    rewind->buffer = malloc(capacity);
+    if (rewind->buffer == NULL) {
+        free(rewind);
+        return NULL;
+    }
+    rewind->capacity = capacity;
+
+    return rewind;
+
+}
+
+void rewind_free(Rewind* rewind) {
+    if (rewind == NULL) {
+        return;
+    }
+    free(rewind->buffer);
+    free(rewind);
+}
+
+// Byte copies in and out of the circular buffer at any offset.
+static void put_bytes(Rewind* rewind, size_t at, const void* data, size_t len) {
+    at %= rewind->capacity;
+    size_t first = rewind->capacity - at < len ? rewind->capacity - at : len;
+    memcpy(rewind->buffer + at, data, first);
+    memcpy(rewind->buffer, (const uint8_t*)data + first, len - first);
+}
+
+static void get_bytes(const Rewind* rewind, size_t at, void* data, size_t len) {
+    at %= rewind->capacity;
+    size_t first = rewind->capacity - at < len ? rewind->capacity - at : len;
+    memcpy(data, rewind->buffer + at, first);
+    memcpy((uint8_t*)data + first, rewind->buffer, len - first);
+}
+
+// RLE of a XOR delta: (uint16_t skip, uint16_t count) pairs, each followed by
+// count literal bytes to XOR in after skipping skip unchanged bytes.
+static size_t delta_encode(const uint8_t* before, const uint8_t* after, size_t size, uint8_t* out) {
+
+    uint8_t* start = out;
+    size_t pos = 0;
+
+    while (pos < size) {
+        size_t zeros = 0;
+        while (pos + zeros < size && before[pos + zeros] == after[pos + zeros]) {
+            zeros++;
+        }
+        pos += zeros;
+        if (pos == size) {
+            break;
+        }
+
+        // a run longer than the skip field holds becomes empty literals
+        while (zeros > UINT16_MAX) {
+            uint16_t pair[2] = {UINT16_MAX, 0};
+            memcpy(out, pair, sizeof(pair));
+            out += sizeof(pair);
+            zeros -= UINT16_MAX;
+        }
+
+        // extend the literal until a gap long enough to be worth a new run
+        size_t count = 0;
+        size_t gap = 0;
+        while (pos + count + gap < size && count + gap < UINT16_MAX && gap < REWIND_MIN_GAP) {
+            if (before[pos + count + gap] != after[pos + count + gap]) {
+                count += gap + 1;
+                gap = 0;
+            } else {
+                gap++;
+            }
+        }
+
+        uint16_t pair[2] = {(uint16_t)zeros, (uint16_t)count};
+        memcpy(out, pair, sizeof(pair));
+        out += sizeof(pair);
+        for (size_t i = 0; i < count; i++) {
+            *out++ = before[pos + i] ^ after[pos + i];
+        }
+        pos += count;
+    }
+
+    return out - start;
+
+}
+
+static void delta_apply(uint8_t* state, const uint8_t* delta, size_t len) {
+
+    const uint8_t* end = delta + len;
+    size_t pos = 0;
+
+    while (delta < end) {
+        uint16_t pair[2];
+        memcpy(pair, delta, sizeof(pair));
+        delta += sizeof(pair);
+        pos += pair[0];
+        for (uint16_t i = 0; i < pair[1]; i++) {
+            state[pos++] ^= *delta++;
+        }
+    }
+
+}
+
+// Throw away the oldest record.
+static void drop_oldest(Rewind* rewind) {
+    size_t tail = rewind->head + rewind->capacity - rewind->used;
+    uint32_t len;
+    get_bytes(rewind, tail, &len, sizeof(len));
+    rewind->used -= len + 2 * sizeof(len);
+    rewind->frames--;
+}
+
+void rewind_push(Rewind* rewind, const Chip8* c8) {
+
+    size_t size = savestate_save(c8, rewind->scratch);
+    if (!rewind->has_current || size != rewind->size) {
+        // a machine that changed variant starts its history over
+        memcpy(rewind->current, rewind->scratch, size);
+        rewind->size = size;
+        rewind->has_current = true;
+        rewind->head = 0;
+        rewind->used = 0;
+        rewind->frames = 0;
+        return;
+    }
+
+    uint32_t len = delta_encode(rewind->scratch, rewind->current, size, rewind->encoded);
+    size_t record = len + 2 * sizeof(len);
+    if (record > rewind->capacity) {
+        return;
+    }
+    while (rewind->capacity - rewind->used < record) {
+        drop_oldest(rewind);
+    }
+
+    put_bytes(rewind, rewind->head, &len, sizeof(len));
+    put_bytes(rewind, rewind->head + sizeof(len), rewind->encoded, len);
+    put_bytes(rewind, rewind->head + sizeof(len) + len, &len, sizeof(len));
+    rewind->head = (rewind->head + record) % rewind->capacity;
+    rewind->used += record;
+    rewind->frames++;
+
+    memcpy(rewind->current, rewind->scratch, size);
+
+}
+
+// Step back one pushed frame and load it into c8, false once there's no
+// history left.
+bool rewind_pop(Rewind* rewind, Chip8* c8) {
+
+    if (rewind->frames == 0) {
+        return false;
+    }
+
+    uint32_t len;
+    size_t end = rewind->head + rewind->capacity;
+    get_bytes(rewind, end - sizeof(len), &len, sizeof(len));
+    get_bytes(rewind, end - sizeof(len) - len, rewind->encoded, len);
+
+    size_t record = len + 2 * sizeof(len);
+    rewind->head = (end - record) % rewind->capacity;
+    rewind->used -= record;
+    rewind->frames--;
+
+    delta_apply(rewind->current, rewind->encoded, len);
+    return savestate_load(c8, rewind->current, rewind->size);
+
+}
@@ -0,0 +1,392 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "include/chip8.h"
+#include "include/stream.h"
+
+// how long the stream thread sleeps in poll() when there's nothing to do,
+// a new frame waits at most this long to go out
+#define STREAM_POLL_MS      4
+
+// a keyframe to everyone once a second
+#define STREAM_KEYFRAME_FRAMES  60
+
+// what a viewer can have queued before it starts skipping updates, a few
+// dozen full high resolution XO-CHIP updates
+#define STREAM_BUFFER       (64 * 1024)
+
+// the largest message: a delta of every row on both planes
+#define STREAM_MESSAGE_MAX  (4 + DISPLAY_PLANES * (8 + HIRES_HEIGHT * ROW_WORDS * 8))
+
+typedef struct StreamViewer {
+    int fd;
+    uint16_t keys;
+    bool needs_keyframe;
+
+    // keypad words come in two bytes at a time, maybe split
+    uint8_t in[2];
+    size_t in_len;
+
+    // out[start, end) is still to be sent
+    size_t start;
+    size_t end;
+    uint8_t out[STREAM_BUFFER];
+} StreamViewer;
+
+static size_t put_u64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+    return 8;
+}
+
+static int frame_height(const Frame* frame) {
+    return frame->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+}
+
+static int frame_words(const Frame* frame) {
+    return frame->hires ? ROW_WORDS : 1;
+}
+
+// Type, flags and the length in front of the payload once it's known.
+static size_t finish_message(uint8_t* message, uint8_t type, uint8_t flags, size_t size) {
+    uint16_t length = (uint16_t)(size - 2);
+    message[0] = length & 0xFF;
+    message[1] = length >> 8;
+    message[2] = type;
+    message[3] = flags;
+    return size;
+}
+
+static size_t encode_keyframe(const Frame* frame, uint8_t* message) {
+
+    int height = frame_height(frame);
+    int words = frame_words(frame);
+    uint8_t flags = frame->hires ? STREAM_HIRES : 0;
+    size_t size = 4;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        uint64_t lit = 0;
+        for (int y = 0; y < height; y++) {
+            for (int w = 0; w < words; w++) {
+                lit |= frame->display[plane][y][w];
+            }
+        }
+        if (!lit) {
+            continue;
+        }
+        flags |= STREAM_PLANE(plane);
+        for (int y = 0; y < height; y++) {
+            for (int w = 0; w < words; w++) {
+                size += put_u64(message + size, frame->display[plane][y][w]);
+            }
+        }
+    }
+
+    return finish_message(message, STREAM_KEYFRAME, flags, size);
+
+}
+
+// Delta from sent to frame, which have to be the same resolution. Returns 0
+// when nothing changed.
+static size_t encode_delta(const Frame* sent, const Frame* frame, uint8_t* message) {
+
+    int height = frame_height(frame);
+    int words = frame_words(frame);
+    uint8_t flags = frame->hires ? STREAM_HIRES : 0;
+    size_t size = 4;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        uint64_t rows = 0;
+        for (int y = 0; y < height; y++) {
+            for (int w = 0; w < words; w++) {
+                if (frame->display[plane][y][w] != sent->display[plane][y][w]) {
+                    rows |= 1ull << y;
+                }
+            }
+        }
+        if (!rows) {
+            continue;
+        }
+        flags |= STREAM_PLANE(plane);
+        size += put_u64(message + size, rows);
+        for (int y = 0; y < height; y++) {
+            if (rows & (1ull << y)) {
+                for (int w = 0; w < words; w++) {
+                    size += put_u64(message + size, frame->display[plane][y][w] ^ sent->display[plane][y][w]);
+                }
+            }
+        }
+    }
+
+    if (!(flags & ~STREAM_HIRES)) {
+        return 0;
+    }
+    return finish_message(message, STREAM_DELTA, flags, size);
+
+}
+
+// Queue a message for a viewer, false when it doesn't fit.
+static bool queue(StreamViewer* viewer, const uint8_t* message, size_t size) {
+    if (viewer->end + size > STREAM_BUFFER) {
+        memmove(viewer->out, viewer->out + viewer->start, viewer->end - viewer->start);
+        viewer->end -= viewer->start;
+        viewer->start = 0;
+    }
+    if (viewer->end + size > STREAM_BUFFER) {
+        return false;
+    }
+    memcpy(viewer->out + viewer->end, message, size);
+    viewer->end += size;
+    return true;
+}
+
+static void drop_viewer(Stream* stream, int index) {
+    close(stream->viewers[index].fd);
+    stream->viewer_count--;
+    if (index != stream->viewer_count) {
+        memcpy(&stream->viewers[index], &stream->viewers[stream->viewer_count], sizeof(StreamViewer));
+    }
+}
+
+static void accept_viewers(Stream* stream) {
+    for (;;) {
+        int fd = accept(stream->listener, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        if (stream->viewer_count == stream->max_viewers) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        StreamViewer* viewer = &stream->viewers[stream->viewer_count++];
+        viewer->fd = fd;
+        viewer->keys = 0;
+        viewer->needs_keyframe = true;
+        viewer->in_len = 0;
+        viewer->start = 0;
+        viewer->end = 0;
+    }
+}
+
+// Take in whatever keypad words arrived, false once the viewer went away.
+static bool read_keys(StreamViewer* viewer) {
+    uint8_t buffer[256];
+    for (;;) {
+        ssize_t got = recv(viewer->fd, buffer, sizeof(buffer), 0);
+        if (got == 0) {
+            return false;
+        }
+        if (got < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        for (ssize_t i = 0; i < got; i++) {
+            viewer->in[viewer->in_len++] = buffer[i];
+            if (viewer->in_len == 2) {
+                viewer->keys = viewer->in[0] | viewer->in[1] << 8;
+                viewer->in_len = 0;
+            }
+        }
+    }
+}
+
+// Send as much of the queue as the socket takes, false once the viewer went
+// away.
+static bool flush(StreamViewer* viewer) {
+    while (viewer->start < viewer->end) {
+        ssize_t sent = send(viewer->fd, viewer->out + viewer->start, viewer->end - viewer->start, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        viewer->start += sent;
+    }
+    viewer->start = 0;
+    viewer->end = 0;
+    return true;
+}
+
+// Turn the newest frame into a keyframe and a delta against the last one and
+// hand each viewer the one it needs. A viewer still waiting on a keyframe
+// only gets one once everything queued before it went out, so a slow viewer
+// holds at most one update's worth of stale frames.
+static void send_frame(Stream* stream, const Frame* frame, uint8_t* keyframe, uint8_t* delta) {
+
+    size_t keyframe_size = encode_keyframe(frame, keyframe);
+    size_t delta_size = 0;
+    bool everyone = !stream->has_sent || frame->hires != stream->sent.hires
+                    || ++stream->since_keyframe >= STREAM_KEYFRAME_FRAMES;
+    if (everyone) {
+        stream->since_keyframe = 0;
+    } else {
+        delta_size = encode_delta(&stream->sent, frame, delta);
+    }
+    memcpy(&stream->sent, frame, sizeof(Frame));
+    stream->has_sent = true;
+
+    for (int i = 0; i < stream->viewer_count; i++) {
+        StreamViewer* viewer = &stream->viewers[i];
+        if (everyone) {
+            viewer->needs_keyframe = true;
+        }
+        if (viewer->needs_keyframe) {
+            if (viewer->start == viewer->end) {
+                viewer->needs_keyframe = !queue(viewer, keyframe, keyframe_size);
+            }
+        } else if (delta_size && !queue(viewer, delta, delta_size)) {
+            viewer->needs_keyframe = true;
+        }
+    }
+
+}
+
+static void* stream_thread(void* arg) {
+
+    Stream* stream = arg;
+    struct pollfd* polls = calloc(stream->max_viewers + 1, sizeof(struct pollfd));
+    uint8_t* keyframe = malloc(STREAM_MESSAGE_MAX);
+    uint8_t* delta = malloc(STREAM_MESSAGE_MAX);
+    if (polls == NULL || keyframe == NULL || delta == NULL) {
+        free(polls);
+        free(keyframe);
+        free(delta);
+        return NULL;
+    }
+
+    while (!atomic_load(&stream->stop)) {
+        polls[0].fd = stream->listener;
+        polls[0].events = POLLIN;
+        for (int i = 0; i < stream->viewer_count; i++) {
+            polls[i + 1].fd = stream->viewers[i].fd;
+            polls[i + 1].events = POLLIN | (stream->viewers[i].start < stream->viewers[i].end ? POLLOUT : 0);
+            polls[i + 1].revents = 0;
+        }
+        int count = stream->viewer_count;
+        poll(polls, count + 1, STREAM_POLL_MS);
+
+        // backwards, dropping a viewer moves the last one into its place
+        for (int i = count - 1; i >= 0; i--) {
+            if (polls[i + 1].revents && !read_keys(&stream->viewers[i])) {
+                drop_viewer(stream, i);
+            }
+        }
+        if (polls[0].revents & POLLIN) {
+            accept_viewers(stream);
+        }
+
+        const Frame* frame = frames_consume(&stream->frames);
+        if (frame) {
+            send_frame(stream, frame, keyframe, delta);
+        }
+
+        uint16_t keys = 0;
+        for (int i = stream->viewer_count - 1; i >= 0; i--) {
+            if (!flush(&stream->viewers[i])) {
+                drop_viewer(stream, i);
+                continue;
+            }
+            keys |= stream->viewers[i].keys;
+        }
+        if (keys != stream_keys(stream)) {
+            atomic_store_explicit(&stream->keys, keys, memory_order_relaxed);
+            if (stream->on_keys) {
+                stream->on_keys(stream->on_keys_user);
+            }
+        }
+    }
+
+    free(polls);
+    free(keyframe);
+    free(delta);
+    return NULL;
+
+}
+
+// Listen on port (every interface) for up to max_viewers viewers at a time,
+// calling on_keys(user) whenever their keys change. NULL with errno set when
+// the port can't be opened.
+Stream* stream_open(uint16_t port, int max_viewers, StreamKeys on_keys, void* user) {
+
+    Stream* stream = calloc(1, sizeof(Stream));
+    if (stream == NULL) {
+        return NULL;
+    }
+    stream->viewers = calloc(max_viewers, sizeof(StreamViewer));
+    if (stream->viewers == NULL) {
+        free(stream);
+        return NULL;
+    }
+    stream->max_viewers = max_viewers;
+    stream->on_keys = on_keys;
+    stream->on_keys_user = user;
+    frames_init(&stream->frames);
+    atomic_init(&stream->keys, 0);
+    atomic_init(&stream->stop, false);
+
+    stream->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (stream->listener < 0) {
+        free(stream->viewers);
+        free(stream);
+        return NULL;
+    }
+
+    int one = 1;
+    setsockopt(stream->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    fcntl(stream->listener, F_SETFL, fcntl(stream->listener, F_GETFL) | O_NONBLOCK);
+
+    if (bind(stream->listener, (struct sockaddr*)&address, sizeof(address)) < 0
+            || listen(stream->listener, 16) < 0
+            || pthread_create(&stream->thread, NULL, stream_thread, stream)) {
+        close(stream->listener);
+        free(stream->viewers);
+        free(stream);
+        return NULL;
+    }
+
+    return stream;
+
+}
+
+void stream_close(Stream* stream) {
+
+    if (stream == NULL) {
+        return;
+    }
+
+    atomic_store(&stream->stop, true);
+    pthread_join(stream->thread, NULL);
+
+    for (int i = 0; i < stream->viewer_count; i++) {
+        close(stream->viewers[i].fd);
+    }
+    close(stream->listener);
+    free(stream->viewers);
+    free(stream);
+
+}
+
+// Hand the stream the frame c8 just finished, never blocks. Frames the stream
+// thread didn't get to before the next one are simply skipped.
+void stream_frame(Stream* stream, const Chip8* c8) {
+    Frame* back = frames_back(&stream->frames);
+    memcpy(back->display, chip8_framebuffer(c8), sizeof(back->display));
+    back->hires = c8->hires;
+    frames_publish(&stream->frames);
+}
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/trace.h"
+
+// 64k records is 512KB per traced instance, plenty of slack for the writer
+// to get scheduled without the interpreter ever noticing.
+#define TRACE_RING_RECORDS  (1 << 16)
+#define TRACE_BATCH         4096
+
+static void write_records(void* user, const void* batch, size_t count) {
+    Trace* trace = user;
+    fwrite(batch, sizeof(TraceRecord), count, trace->file);
+}
+
+Trace* trace_open(const char* path) {
+
+    Trace* trace = calloc(1, sizeof(Trace));
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) {
+        free(trace);
+        return NULL;
+    }
+
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, trace->file);
+
+    if (!ring_writer_start(&trace->writer, TRACE_RING_RECORDS, sizeof(TraceRecord), TRACE_BATCH,
+                           1000000, write_records, trace)) {
+        fclose(trace->file);
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+
+}
+
+void trace_close(Trace* trace) {
+
+    if (trace == NULL) {
+        return;
+    }
+
+    ring_writer_stop(&trace->writer);
+    fclose(trace->file);
+    free(trace);
+
+}
@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "include/chip8.h"
+#include "include/trace.h"
+
+// Text decoder for the binary traces written by `mygame -t`, prints one line
+// per executed instruction (SUPER-CHIP and XO-CHIP ones included, the trace
+// doesn't say which variant wrote it):
+//
+//     PC:204 OP:7001 ADD  V0, 0x01     I:000 V0=01
+
+static void disassemble(uint16_t op, char* out, size_t size) {
+
+    unsigned X = (op >> 8) & 0xF;
+    unsigned Y = (op >> 4) & 0xF;
+    unsigned N = op & 0xF;
+    unsigned NN = op & 0xFF;
+    unsigned NNN = op & 0xFFF;
+
+    switch (op >> 12) {
+        case 0x0:
+            if (op == 0x00E0) { snprintf(out, size, "CLS"); return; }
+            if (op == 0x00EE) { snprintf(out, size, "RET"); return; }
+            if (op == 0x00FB) { snprintf(out, size, "SCR"); return; }
+            if (op == 0x00FC) { snprintf(out, size, "SCL"); return; }
+            if (op == 0x00FD) { snprintf(out, size, "EXIT"); return; }
+            if (op == 0x00FE) { snprintf(out, size, "LOW"); return; }
+            if (op == 0x00FF) { snprintf(out, size, "HIGH"); return; }
+            if ((op & 0xFFF0) == 0x00C0) { snprintf(out, size, "SCD  %u", N); return; }
+            if ((op & 0xFFF0) == 0x00D0) { snprintf(out, size, "SCU  %u", N); return; }
+            snprintf(out, size, "SYS  0x%03X", NNN);
+            return;
+        case 0x1: snprintf(out, size, "JP   0x%03X", NNN); return;
+        case 0x2: snprintf(out, size, "CALL 0x%03X", NNN); return;
+        case 0x3: snprintf(out, size, "SE   V%X, 0x%02X", X, NN); return;
+        case 0x4: snprintf(out, size, "SNE  V%X, 0x%02X", X, NN); return;
+        case 0x5:
+            if (N == 0x2) { snprintf(out, size, "SAVE V%X-V%X", X, Y); return; }
+            if (N == 0x3) { snprintf(out, size, "LOAD V%X-V%X", X, Y); return; }
+            snprintf(out, size, "SE   V%X, V%X", X, Y);
+            return;
+        case 0x6: snprintf(out, size, "LD   V%X, 0x%02X", X, NN); return;
+        case 0x7: snprintf(out, size, "ADD  V%X, 0x%02X", X, NN); return;
+        case 0x8: {
+            static const char* alu[16] = {
+                "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL,
+            };
+            if (alu[N]) {
+                snprintf(out, size, "%-4s V%X, V%X", alu[N], X, Y);
+                return;
+            }
+            break;
+        }
+        case 0x9: snprintf(out, size, "SNE  V%X, V%X", X, Y); return;
+        case 0xA: snprintf(out, size, "LD   I, 0x%03X", NNN); return;
+        case 0xB: snprintf(out, size, "JP   V0, 0x%03X", NNN); return;
+        case 0xC: snprintf(out, size, "RND  V%X, 0x%02X", X, NN); return;
+        case 0xD: snprintf(out, size, "DRW  V%X, V%X, %u", X, Y, N); return;
+        case 0xE:
+            if (NN == 0x9E) { snprintf(out, size, "SKP  V%X", X); return; }
+            if (NN == 0xA1) { snprintf(out, size, "SKNP V%X", X); return; }
+            break;
+        case 0xF:
+            if (op == 0xF000) { snprintf(out, size, "LD   I, LONG"); return; }
+            if (op == 0xF002) { snprintf(out, size, "AUDIO"); return; }
+            switch (NN) {
+                case 0x01: snprintf(out, size, "PLANE %u", X); return;
+                case 0x30: snprintf(out, size, "LD   HF, V%X", X); return;
+                case 0x3A: snprintf(out, size, "PITCH V%X", X); return;
+                case 0x75: snprintf(out, size, "LD   R, V%X", X); return;
+                case 0x85: snprintf(out, size, "LD   V%X, R", X); return;
+                case 0x07: snprintf(out, size, "LD   V%X, DT", X); return;
+                case 0x0A: snprintf(out, size, "LD   V%X, K", X); return;
+                case 0x15: snprintf(out, size, "LD   DT, V%X", X); return;
+                case 0x18: snprintf(out, size, "LD   ST, V%X", X); return;
+                case 0x1E: snprintf(out, size, "ADD  I, V%X", X); return;
+                case 0x29: snprintf(out, size, "LD   F, V%X", X); return;
+                case 0x33: snprintf(out, size, "LD   B, V%X", X); return;
+                case 0x55: snprintf(out, size, "LD   [I], V%X", X); return;
+                case 0x65: snprintf(out, size, "LD   V%X, [I]", X); return;
+            }
+            break;
+    }
+
+    snprintf(out, size, "???");
+
+}
+
+int main(int argc, char** argv) {
+
+    if (argc != 2) {
+        error("Usage: chip8_trace_decode trace.bin\n");
+        return 1;
+    }
+
+    FILE* fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        perror("Error while opening trace");
+        return 1;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1
+            || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        error("[FAILED] %s is not a CHIP-8 trace\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        error("[FAILED] unsupported trace version %u (record size %u)\n", header.version, header.record_size);
+        fclose(fp);
+        return 1;
+    }
+
+    TraceRecord records[4096];
+    size_t count;
+    char text[32];
+
+    while ((count = fread(records, sizeof(TraceRecord), 4096, fp)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            TraceRecord* record = &records[i];
+            disassemble(record->opcode, text, sizeof(text));
+            if (record->reg == TRACE_NO_REG) {
+                printf("PC:%03X OP:%04X %-16s I:%03X\n", record->pc, record->opcode, text, record->i);
+            } else {
+                printf("PC:%03X OP:%04X %-16s I:%03X V%X=%02X\n", record->pc, record->opcode, text,
+                       record->i, record->reg, record->value);
+            }
+        }
+    }
+
+    fclose(fp);
+    return 0;
+
+}